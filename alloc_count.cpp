@@ -0,0 +1,44 @@
+#include "alloc_count.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> allocs{0};
+
+auto allocCount() -> uint64_t
+{
+  return allocs.load(std::memory_order_relaxed);
+}
+
+auto operator new(size_t sz) -> void *
+{
+  allocs.fetch_add(1, std::memory_order_relaxed);
+  if (auto ret = std::malloc(sz ? sz : 1))
+    return ret;
+  throw std::bad_alloc{};
+}
+
+auto operator new[](size_t sz) -> void *
+{
+  return operator new(sz);
+}
+
+auto operator delete(void *p) noexcept -> void
+{
+  std::free(p);
+}
+
+auto operator delete[](void *p) noexcept -> void
+{
+  std::free(p);
+}
+
+auto operator delete(void *p, size_t) noexcept -> void
+{
+  std::free(p);
+}
+
+auto operator delete[](void *p, size_t) noexcept -> void
+{
+  std::free(p);
+}
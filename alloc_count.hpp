@@ -0,0 +1,7 @@
+#pragma once
+#include <cstdint>
+
+// Calls to the global operator new so far, on all threads. Counting replaces
+// operator new and delete with malloc and free plus one relaxed atomic add,
+// so the difference around a piece of code is what it allocated.
+auto allocCount() -> uint64_t;
@@ -0,0 +1,145 @@
+#include "azure_tts.hpp"
+#include "log/log.hpp"
+#include <algorithm>
+#include <iostream>
+
+static auto textToPcmReq(HttpConn &conn, const std::string &token, const std::string &xml) -> void
+{
+  auto curl = conn.reset("https://eastus.tts.speech.microsoft.com/cognitiveservices/v1");
+  curl_easy_setopt(curl, CURLOPT_POST, 1L);
+  conn.setHeaders({"Accept:",
+                   "User-Agent: curl/7.68.0",
+                   "Authorization: Bearer " + token,
+                   "Content-Type: application/ssml+xml",
+                   "X-Microsoft-OutputFormat: raw-24khz-16bit-mono-pcm"});
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(xml.size()));
+  curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, xml.c_str());
+}
+
+// the HTTP status, 0 if the transfer failed
+static auto textToPcmRes(const HttpConn &conn, CURLcode res) -> long
+{
+  if (res != CURLE_OK)
+  {
+    LOG("tts transfer failed");
+    return 0;
+  }
+  const auto codep = conn.responseCode();
+  if (codep != 200 && codep != 401)
+  {
+    LOG("http code:", codep);
+    LOG("content:", conn.out);
+  }
+  return codep;
+}
+
+AzureTts::AzureTts(EventLoop &loop, TokenManager &token, std::string wsUrl)
+  : loop(loop), token(token), wsUrl(std::move(wsUrl))
+{
+}
+
+auto AzureTts::synthesize(const std::string & /*voice*/, const std::string &ssml, OnAudio onAudio, OnDone onDone)
+  -> uint64_t
+{
+  const auto id = ++lastId;
+  auto &s = syntheses[id];
+  s.ssml = ssml;
+  s.onAudio = std::move(onAudio);
+  s.onDone = std::move(onDone);
+  start(id);
+  return id;
+}
+
+auto AzureTts::start(uint64_t id) -> void
+{
+  if (!token.valid())
+  {
+    token.refresh([this, id]() {
+      if (syntheses.find(id) != std::end(syntheses))
+        start(id);
+    });
+    return;
+  }
+  auto &s = syntheses.at(id);
+  s.token = token.get();
+  if (wsUrl.empty())
+    startRest(id, s);
+  else
+    startWs(id, s);
+}
+
+auto AzureTts::startRest(uint64_t id, Synthesis &s) -> void
+{
+  if (idleConns.empty())
+    idleConns.push_back(std::make_unique<HttpConn>("tts"));
+  s.conn = std::move(idleConns.back());
+  idleConns.pop_back();
+  textToPcmReq(*s.conn, s.token, s.ssml);
+  s.conn->onData([this, id](const char *data, size_t sz) {
+    auto &s = syntheses.at(id);
+    if (s.conn->responseCode() != 200)
+    {
+      // keep the error body for the log
+      s.conn->out.append(data, sz);
+      return;
+    }
+    s.onAudio(data, sz);
+  });
+  loop.add(*s.conn, [this, id](CURLcode res) {
+    auto &s = syntheses.at(id);
+    const auto status = textToPcmRes(*s.conn, res);
+    idleConns.push_back(std::move(s.conn));
+    finish(id, status);
+  });
+}
+
+auto AzureTts::startWs(uint64_t id, Synthesis &s) -> void
+{
+  auto iter = std::find_if(std::begin(wsTts), std::end(wsTts), [](const auto &ws) { return !ws->busy(); });
+  if (iter == std::end(wsTts))
+    iter = wsTts.insert(std::end(wsTts), std::make_unique<WsTts>(loop, wsUrl));
+  s.ws = iter->get();
+  s.ws->synthesize(
+    s.token,
+    s.ssml,
+    [this, id](const char *data, size_t sz) { syntheses.at(id).onAudio(data, sz); },
+    [this, id](long status) {
+      syntheses.at(id).ws = nullptr;
+      finish(id, status);
+    });
+}
+
+auto AzureTts::finish(uint64_t id, long status) -> void
+{
+  auto &s = syntheses.at(id);
+  if (status == 401)
+  {
+    std::clog << "401 we need to re-authenticate on Azure TTS\n";
+    token.invalidate(s.token);
+    if (++s.attempts < 2)
+    {
+      start(id);
+      return;
+    }
+    LOG("giving up to TTS");
+  }
+  auto done = std::move(s.onDone);
+  syntheses.erase(id);
+  done(status);
+}
+
+auto AzureTts::cancel(uint64_t id) -> void
+{
+  const auto iter = syntheses.find(id);
+  if (iter == std::end(syntheses))
+    return;
+  auto &s = iter->second;
+  if (s.conn)
+  {
+    loop.cancel(*s.conn);
+    idleConns.push_back(std::move(s.conn));
+  }
+  if (s.ws)
+    s.ws->cancel();
+  syntheses.erase(iter);
+}
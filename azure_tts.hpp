@@ -0,0 +1,49 @@
+#pragma once
+#include "event_loop.hpp"
+#include "http_conn.hpp"
+#include "token_manager.hpp"
+#include "tts_backend.hpp"
+#include "ws_tts.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Azure speech synthesis, either a REST request per synthesis on a pool of
+// kept-alive connections or turns on a pool of WebSockets. A synthesis waits
+// for a valid token first and gets one retry with a fresh token if Azure
+// refuses the one it carried.
+class AzureTts : public TtsBackend
+{
+public:
+  // REST unless wsUrl is set
+  AzureTts(EventLoop &, TokenManager &, std::string wsUrl);
+
+  auto synthesize(const std::string &voice, const std::string &ssml, OnAudio, OnDone) -> uint64_t override;
+  auto cancel(uint64_t id) -> void override;
+
+private:
+  struct Synthesis
+  {
+    std::string ssml;
+    OnAudio onAudio;
+    OnDone onDone;
+    std::string token;
+    int attempts = 0;
+    std::unique_ptr<HttpConn> conn;
+    WsTts *ws = nullptr;
+  };
+
+  auto start(uint64_t id) -> void;
+  auto startRest(uint64_t id, Synthesis &) -> void;
+  auto startWs(uint64_t id, Synthesis &) -> void;
+  auto finish(uint64_t id, long status) -> void;
+
+  EventLoop &loop;
+  TokenManager &token;
+  std::string wsUrl;
+  std::unordered_map<uint64_t, Synthesis> syntheses;
+  std::vector<std::unique_ptr<HttpConn>> idleConns;
+  std::vector<std::unique_ptr<WsTts>> wsTts;
+  uint64_t lastId = 0;
+};
@@ -0,0 +1,131 @@
+// Runs ClipStore through reopen and the damage a crash can leave: PCM torn
+// under an intact header, in the index and with the index deleted, and a
+// torn tail. Then times opening a store filled to the 256 MB default cap,
+// which reads every clip to check its CRC-32.
+//
+//   g++ -O2 -std=c++17 -I.. clip_store.cpp ../clip_store.cpp -o clip_store && ./clip_store
+#include "clip_store.hpp"
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr size_t Cap = size_t{256} << 20;
+// three seconds at 24 kHz
+constexpr size_t Samples = 3 * 24000;
+
+static auto ssml(int i) -> std::string
+{
+  return "<speak><voice name='en-US-GuyNeural'>clip " + std::to_string(i) + "</voice></speak>";
+}
+
+static auto pcm(int i) -> std::vector<int16_t>
+{
+  std::vector<int16_t> ret(Samples);
+  std::mt19937 rng(i);
+  for (auto &x : ret)
+    x = static_cast<int16_t>(rng());
+  return ret;
+}
+
+// clips of [0, n) that are found with the right PCM
+static auto found(ClipStore &store, int n) -> int
+{
+  auto ret = 0;
+  for (auto i = 0; i < n; ++i)
+  {
+    const auto clip = store.find(i, ssml(i));
+    const auto want = pcm(i);
+    ret += clip.size == want.size() && std::equal(clip.data, clip.data + clip.size, want.data()) ? 1 : 0;
+  }
+  return ret;
+}
+
+static auto fileSize(const std::string &path) -> off_t
+{
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+// flips a byte in the middle of the PCM of the nth of the equally sized
+// records, so the header still reads fine
+static auto tear(const std::string &dir, int n) -> void
+{
+  const auto path = dir + "/clips.dat";
+  const auto record = fileSize(path) / 4;
+  const auto fd = open(path.c_str(), O_RDWR);
+  char byte;
+  pread(fd, &byte, 1, record * n + record / 2);
+  byte = static_cast<char>(~byte);
+  pwrite(fd, &byte, 1, record * n + record / 2);
+  close(fd);
+}
+
+int main()
+{
+  char tmpl[] = "/tmp/clip_store.XXXXXX";
+  const std::string dir = mkdtemp(tmpl);
+  auto failed = 0;
+  const auto expect = [&](const char *what, bool ok) {
+    failed += ok ? 0 : 1;
+    std::cout << (ok ? "ok   " : "FAIL ") << what << "\n";
+  };
+  const auto reset = [&]() {
+    unlink((dir + "/clips.dat").c_str());
+    unlink((dir + "/clips.idx").c_str());
+    ClipStore store(dir, Cap);
+    for (auto i = 0; i < 4; ++i)
+      store.insert(i, ssml(i), pcm(i));
+  };
+
+  reset();
+  {
+    ClipStore store(dir, Cap);
+    expect("reopened, all clips found", found(store, 4) == 4);
+  }
+
+  tear(dir, 1);
+  {
+    ClipStore store(dir, Cap);
+    expect("PCM torn under an intact header is dropped", found(store, 4) == 3 && !store.find(1, ssml(1)).data);
+  }
+
+  reset();
+  tear(dir, 2);
+  unlink((dir + "/clips.idx").c_str());
+  {
+    ClipStore store(dir, Cap);
+    expect("and skipped when the index is rebuilt", found(store, 4) == 3 && !store.find(2, ssml(2)).data);
+  }
+
+  reset();
+  const auto full = fileSize(dir + "/clips.dat");
+  truncate((dir + "/clips.dat").c_str(), full - 1000);
+  {
+    ClipStore store(dir, Cap);
+    expect("a torn tail is cut off", found(store, 4) == 3 && fileSize(dir + "/clips.dat") == full / 4 * 3);
+  }
+
+  reset();
+  {
+    ClipStore store(dir, Cap);
+    // stop a record or two short of the cap, so opening does not compact
+    for (auto i = 4; static_cast<size_t>(fileSize(dir + "/clips.dat") * (i + 2) / i) < Cap; ++i)
+      store.insert(i, ssml(i), pcm(i));
+  }
+  const auto t0 = std::chrono::steady_clock::now();
+  ClipStore store(dir, Cap);
+  const std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - t0;
+  const auto mb = fileSize(dir + "/clips.dat") / 1048576.;
+  std::cout << "open of " << mb << " MB, from the page cache: " << ms.count() << " ms, " << mb / ms.count() * 1000
+            << " MB/s\n";
+
+  unlink((dir + "/clips.dat").c_str());
+  unlink((dir + "/clips.idx").c_str());
+  rmdir(dir.c_str());
+  return failed != 0;
+}
@@ -0,0 +1,157 @@
+// Times dedup() on chat spam of up to 200 words and on growing inputs, and
+// checks it against the scan it replaced.
+//
+//   g++ -O2 -std=c++17 -I.. dedup.cpp ../dedup.cpp -o dedup && ./dedup
+#include "dedup.hpp"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// the original restart-after-every-erase scan from main.cpp
+static auto dedupRef(const std::string &var) -> std::string
+{
+  std::vector<std::string> words;
+  for (size_t p0 = 0; p0 < var.size();)
+  {
+    auto p1 = var.find(' ', p0);
+    if (p1 == std::string::npos)
+      p1 = var.size();
+    words.push_back(var.substr(p0, p1 - p0));
+    p0 = p1 + 1;
+  }
+  const auto eq = [&](size_t i, size_t j, size_t w) {
+    if (i + w > words.size() || j + w > words.size())
+      return false;
+    for (auto k = 0u; k < w; ++k)
+      if (words[i + k] != words[j + k])
+        return false;
+    return true;
+  };
+  for (bool didUpdate = true; didUpdate;)
+  {
+    didUpdate = false;
+    for (auto w = 1u; w < words.size() / 2 && !didUpdate; ++w)
+      for (auto i = 0u; i < words.size() - w && !didUpdate; ++i)
+        for (auto r = 1u; !didUpdate; ++r)
+          if (!eq(i, i + r * w, w))
+          {
+            if (r >= 3)
+            {
+              words.erase(std::begin(words) + i + w, std::begin(words) + i + r * w);
+              didUpdate = true;
+            }
+            else
+              break;
+          }
+  }
+  std::string ret;
+  for (const auto &word : words)
+  {
+    if (!ret.empty())
+      ret += " ";
+    ret += word;
+  }
+  return ret;
+}
+
+static auto repeat(const std::string &s, int n) -> std::string
+{
+  std::string ret;
+  for (auto i = 0; i < n; ++i)
+    ret += (i ? " " : "") + s;
+  return ret;
+}
+
+// microseconds per call
+template <typename F>
+static auto time(F &&f) -> double
+{
+  auto n = 1;
+  for (;;)
+  {
+    const auto t0 = std::chrono::steady_clock::now();
+    for (auto i = 0; i < n; ++i)
+      f();
+    const auto dt = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    if (dt > 200000)
+      return dt / n;
+    n *= 2;
+  }
+}
+
+int main()
+{
+  std::mt19937 rng(1);
+  std::string numbers;
+  for (auto i = 0; i < 200; ++i)
+    numbers += (i ? " " : "") + std::to_string(rng() % 50);
+  std::string stacked;
+  for (auto i = 0; i < 66; ++i)
+    stacked += (i ? " " : "") + repeat("w" + std::to_string(i), 3);
+  const std::vector<std::pair<std::string, std::string>> spam = {
+    {"emote wall", repeat("KEKW", 200)},
+    {"copypasta", repeat("no way dude", 66)},
+    {"mixed copypasta",
+     repeat("I'm not saying it was aliens but", 4) + " " + repeat("it was aliens", 20) + " " + repeat("LUL", 40) + " " +
+       repeat("poggers in the chat", 10)},
+    {"random numbers", numbers},
+    {"stacked triples", stacked},
+    {"no repeats",
+     "so I was thinking about the build you did last stream and honestly the second boss would be way easier if you "
+     "swapped the shield for the bow since it keeps jumping back anyway, also did you ever finish the side quest with "
+     "the merchant in the swamp town because I remember you said you would come back to it after the dungeon and then "
+     "we never saw it again which is a shame because the reward is a unique ring that fits your build really well and "
+     "makes the late game a lot smoother than grinding for the set pieces would be"},
+  };
+
+  auto mismatches = 0;
+  std::cout << "spam, up to 200 words (reference -> dedup, us per message)\n";
+  for (const auto &[name, text] : spam)
+  {
+    if (dedup(text) != dedupRef(text))
+      ++mismatches;
+    const auto ref = time([&]() { dedupRef(text); });
+    const auto now = time([&]() { dedup(text); });
+    std::cout << "  " << name << ", " << text.size() << " chars: " << ref << " -> " << now << "\n";
+  }
+
+  std::cout << "scaling (us per call)\n";
+  for (auto n : {200, 2000, 20000})
+  {
+    std::string triples;
+    for (auto i = 0; i < n / 3; ++i)
+      triples += (i ? " " : "") + repeat("w" + std::to_string(i), 3);
+    // Thue-Morse has no cubes, so nothing collapses and every period is scanned
+    std::string thueMorse;
+    for (auto i = 0; i < n; ++i)
+      thueMorse += (i ? " " : "") + std::string(__builtin_popcount(i) % 2 ? "a" : "b");
+    std::cout << "  " << n << " words: stacked triples " << time([&]() { dedup(triples); }) << ", thue-morse "
+              << time([&]() { dedup(thueMorse); }) << "\n";
+  }
+
+  // random repeated blocks over a tiny vocabulary hit the collapse order;
+  // one in ten is long enough for the hashed comparisons
+  for (auto t = 0; t < 20000; ++t)
+  {
+    std::string text;
+    const auto vocab = 1 + rng() % 3;
+    const auto size = 1 + rng() % (t % 10 ? 120 : 1500);
+    while (text.size() < size)
+    {
+      std::string block;
+      const auto len = 1 + rng() % 4;
+      for (auto i = 0u; i < len; ++i)
+        block += std::string(1, 'a' + rng() % vocab) + " ";
+      const auto repeats = 1 + rng() % 4;
+      for (auto i = 0u; i < repeats; ++i)
+        text += block;
+    }
+    text.pop_back();
+    if (dedup(text) != dedupRef(text))
+      ++mismatches;
+  }
+  std::cout << mismatches << " mismatches against the reference\n";
+  return mismatches != 0;
+}
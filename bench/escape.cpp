@@ -0,0 +1,137 @@
+// Times escape() against the find()/replace() version it replaced on plain,
+// link-heavy and mention-heavy messages, and checks both agree on random
+// messages. Both end in dedup(), which is timed on its own as well.
+//
+//   g++ -O2 -std=c++17 -I.. escape.cpp ../escape.cpp ../dedup.cpp -o escape && ./escape
+#include "dedup.hpp"
+#include "escape.hpp"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+
+// the original up to dedup(), which rewrote the message in place three times
+static auto escapeRefBuffer(std::string data) -> std::string
+{
+  size_t p0 = 0;
+  while ((p0 = data.find('@', p0)) != std::string::npos)
+  {
+    ++p0;
+    auto p1 = data.find(' ', p0);
+    data.replace(p0, p1 - p0, escName(data.substr(p0, p1 - p0)));
+  }
+
+  for (;;)
+  {
+    {
+      auto p0 = data.find("http://");
+      if (p0 != std::string::npos)
+      {
+        auto p1 = data.find(' ', p0);
+        data.replace(p0, p1 - p0, "http link");
+        continue;
+      }
+    }
+    {
+      auto p0 = data.find("https://");
+      if (p0 != std::string::npos)
+      {
+        auto p1 = data.find(' ', p0);
+        data.replace(p0, p1 - p0, "https link");
+        continue;
+      }
+    }
+    break;
+  }
+
+  std::string buffer;
+  buffer.reserve(data.size());
+  for (size_t pos = 0; pos != data.size(); ++pos)
+  {
+    switch (data[pos])
+    {
+    case '&': buffer.append("&amp;"); break;
+    case '\"': buffer.append("&quot;"); break;
+    case '\'': buffer.append("&apos;"); break;
+    case '<': buffer.append("&lt;"); break;
+    case '>': buffer.append("&gt;"); break;
+    default: buffer.append(&data[pos], 1); break;
+    }
+  }
+  return buffer;
+}
+
+static auto escapeRef(const std::string &name, const std::string &data) -> std::string
+{
+  if (name == "tanja_ultramono")
+    return "";
+  return dedup(escapeRefBuffer(data));
+}
+
+// microseconds per call
+template <typename F>
+static auto time(F &&f) -> double
+{
+  auto n = 1;
+  for (;;)
+  {
+    const auto t0 = std::chrono::steady_clock::now();
+    for (auto i = 0; i < n; ++i)
+      f();
+    const auto dt = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    if (dt > 200000)
+      return dt / n;
+    n *= 2;
+  }
+}
+
+int main()
+{
+  // no links nested in links or mentions inside links, the new scan reads
+  // a URL as one token and differs there on purpose
+  std::mt19937 rng(1);
+  const char *tokens[] = {"hello",
+                          "@some_user42",
+                          "http://example.com/a?b=c",
+                          "https://t.co/xyz",
+                          "a&b",
+                          "<3",
+                          "\"quoted\"",
+                          "it's",
+                          "@cmaennche",
+                          "world",
+                          "hi",
+                          "h",
+                          "ahttp://x"};
+  auto mismatches = 0;
+  for (auto t = 0; t < 200000; ++t)
+  {
+    std::string text;
+    const auto n = rng() % 12;
+    for (auto i = 0u; i < n; ++i)
+      text += (i ? " " : "") + std::string{tokens[rng() % std::size(tokens)]};
+    if (escape("x", text) != escapeRef("x", text))
+      ++mismatches;
+  }
+  std::cout << mismatches << " mismatches against the original on random messages\n";
+
+  std::string links;
+  for (auto i = 0; i < 30; ++i)
+    links += "check https://example.com/page" + std::to_string(i) + " and http://foo.bar/" + std::to_string(i) + " ";
+  std::string mentions;
+  for (auto i = 0; i < 30; ++i)
+    mentions += "@user_" + std::to_string(i) + " hi ";
+  const std::pair<const char *, std::string> messages[] = {
+    {"plain text", "Hey everyone, what's up? I just got home from work & I'm ready to watch the stream <3 let's go"},
+    {"60 links", links},
+    {"30 mentions", mentions},
+  };
+  std::cout << "us per message (original -> escape, dedup alone)\n";
+  for (const auto &[name, text] : messages)
+  {
+    const auto escaped = escapeRefBuffer(text);
+    std::cout << "  " << name << ", " << text.size() << " chars: " << time([&]() { escapeRef("x", text); }) << " -> "
+              << time([&]() { escape("x", text); }) << ", " << time([&]() { dedup(escaped); }) << "\n";
+  }
+  return mismatches != 0;
+}
@@ -0,0 +1,29 @@
+#!/usr/bin/env python3
+# Stand-in for espeak-ng, for espeak_tts.cpp. Reads the text on stdin and
+# writes to stdout what `espeak-ng --stdout` writes: a 22050 Hz 16-bit WAV
+# with the sizes left at their streaming placeholders. The data is a 441 Hz
+# sine at amplitude 10000, 22050 / 50 samples per character of text, and
+# the header is split over writes. Text containing "fail" exits with 1,
+# text containing "8bit" writes an 8-bit header and then hangs for a minute.
+import math
+import struct
+import sys
+import time
+
+text = sys.stdin.read()
+if "fail" in text:
+    sys.exit(1)
+n = 22050 * len(text) // 50
+data = b"".join(struct.pack("<h", int(10000 * math.sin(2 * math.pi * 441 * i / 22050))) for i in range(n))
+fmt = struct.pack("<IHHIIHH", 16, 1, 1, 22050, 44100, 2, 16)
+if "8bit" in text:
+    fmt = struct.pack("<IHHIIHH", 16, 1, 1, 22050, 22050, 1, 8)
+hdr = b"RIFF" + struct.pack("<I", 0x7FFFF024) + b"WAVE" + b"fmt " + fmt + b"data" + struct.pack("<I", 0x7FFFF000)
+out = sys.stdout.buffer
+out.write(hdr[:7])
+out.flush()
+out.write(hdr[7:] + data[:1001])
+out.flush()
+if "8bit" in text:
+    time.sleep(60)
+out.write(data[1001:])
@@ -0,0 +1,107 @@
+// Runs EspeakTts against espeak_standin.py: the WAV header split over
+// reads, resampling 22050 Hz to 24 kHz, a failing espeak, one that hangs
+// after an unusable header, cancel and a missing binary. Then times first
+// audio and whole syntheses of a chat message, which is what the fallback
+// buys when Azure is slow. Pass the real espeak-ng to time it instead; the
+// checks need the stand-in.
+//
+//   g++ -O2 -std=c++17 -I.. espeak_tts.cpp ../espeak_tts.cpp ../event_loop.cpp ../http_conn.cpp -lcurl -o espeak_tts
+//   ./espeak_tts [./espeak_standin.py | espeak-ng]
+#include "espeak_tts.hpp"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+
+using Ms = std::chrono::duration<double, std::milli>;
+
+int main(int argc, char **argv)
+{
+  const std::string binary = argc > 1 ? argv[1] : "./espeak_standin.py";
+  const auto standin = binary.find("standin") != std::string::npos;
+  EventLoop loop;
+  EspeakTts tts(loop, binary);
+  auto failed = 0;
+  auto pending = 0;
+  auto canceled = true;
+  std::function<void()> timing;
+  const auto expect = [&](const char *what, bool ok) {
+    failed += ok ? 0 : 1;
+    std::cout << (ok ? "ok   " : "FAIL ") << what << "\n";
+    if (--pending == 0)
+      timing();
+  };
+
+  if (standin)
+  {
+    pending = 5;
+    // "a & b <3 hello there" and a newline, 22050 * 21 / 50 samples in
+    auto got = std::make_shared<std::string>();
+    tts.synthesize(
+      "en-US-JennyNeural",
+      "<speak><voice name=\"x\">a &amp; b &lt;3 hello there</voice></speak>",
+      [got](const char *data, size_t sz) { got->append(data, sz); },
+      [&, got](long status) {
+        const auto n = got->size() / 2;
+        const auto samples = reinterpret_cast<const int16_t *>(got->data());
+        auto err = 0.;
+        for (auto i = 0u; i < n; ++i)
+          err = std::max(err, std::abs(samples[i] - 10000 * std::sin(2 * M_PI * 441 * i / 24000.)));
+        std::cout << "     " << n << " samples at 24 kHz for 9261 at 22050 Hz, off the ideal sine by " << err << "\n";
+        expect("split header and resampling", status == 200 && n >= 10078 && n <= 10080 && err < 50);
+      });
+    tts.synthesize(
+      "ja-JP-NanamiNeural", "<speak>fail</speak>", [](const char *, size_t) {}, [&](long status) {
+        expect("espeak exiting with 1", status == 0);
+      });
+    // the stand-in sleeps a minute after the header unless it is killed
+    const auto t0 = std::chrono::steady_clock::now();
+    tts.synthesize(
+      "en-US-X", "<speak>8bit</speak>", [](const char *, size_t) {}, [&, t0](long status) {
+        const Ms took = std::chrono::steady_clock::now() - t0;
+        expect("8-bit header, hanging espeak killed", status == 0 && took.count() < 5000);
+      });
+    const auto id = tts.synthesize(
+      "ru-RU-X", "<speak>canceled one</speak>", [&](const char *, size_t) { canceled = false; }, [&](long) {
+        canceled = false;
+      });
+    tts.cancel(id);
+    loop.after(std::chrono::milliseconds{500}, [&]() { expect("cancel", canceled); });
+    static EspeakTts missing(loop, "/nonexistent/espeak-ng");
+    missing.synthesize(
+      "en-GB-X", "<speak>x</speak>", [](const char *, size_t) {}, [&](long status) {
+        expect("missing binary", status == 0 && !EspeakTts::available("/nonexistent/espeak-ng"));
+      });
+  }
+
+  constexpr auto Runs = 20;
+  auto left = Runs;
+  Ms firstAudio{};
+  Ms whole{};
+  std::function<void()> run = [&]() {
+    if (left-- == 0)
+    {
+      std::cout << binary << ": first audio " << firstAudio.count() / Runs << " ms, whole clip " << whole.count() / Runs
+                << " ms\n";
+      exit(failed != 0);
+    }
+    const auto t0 = std::chrono::steady_clock::now();
+    auto first = std::make_shared<bool>(true);
+    tts.synthesize(
+      "en-US-GuyNeural",
+      "<speak>Hey everyone, what's up? I just got home from work and I'm ready to watch the stream</speak>",
+      [&, t0, first](const char *, size_t) {
+        if (*first)
+          firstAudio += std::chrono::steady_clock::now() - t0;
+        *first = false;
+      },
+      [&, t0](long) {
+        whole += std::chrono::steady_clock::now() - t0;
+        run();
+      });
+  };
+  timing = [&]() { loop.after(std::chrono::milliseconds{0}, run); };
+  if (!standin)
+    timing();
+  loop.run();
+}
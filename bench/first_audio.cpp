@@ -0,0 +1,177 @@
+// First-audio time against message length, for a message sent as one SSML
+// document and for the splitSentences() pieces synthesized on up to four
+// connections at once, the way Ctx dispatches them. Playback is replayed
+// from the arrival times: a piece starts when the one before it has played
+// out or when its first audio arrives, whichever is later, and the wait in
+// between counts as a stall.
+//
+// By default it talks to ws_standin.py, whose options model the service;
+// the numbers in the commit used
+//   python3 ws_standin.py --first-audio-ms 150 --ms-per-char 4 --realtime-factor 5 &
+// Given a WebSocket URL and a bearer token it measures Azure instead:
+//   ./first_audio https://eastus.tts.speech.microsoft.com/cognitiveservices/websocket/v1 <token>
+//
+//   g++ -O2 -std=c++17 -I.. first_audio.cpp ../sentences.cpp ../ws_tts.cpp ../ws_conn.cpp ../event_loop.cpp
+//     ../http_conn.cpp -lcurl -o first_audio
+#include "sentences.hpp"
+#include "ws_tts.hpp"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+using Ms = std::chrono::duration<double, std::milli>;
+
+static constexpr auto Workers = 4;
+static constexpr auto Runs = 5;
+
+static auto ssml(std::string_view text) -> std::string
+{
+  return "<speak version='1.0' xml:lang='en-US'><voice name='en-US-GuyNeural'>" + std::string{text} +
+         "</voice></speak>";
+}
+
+// A message split into parts, each a turn on the first idle connection in
+// order. Reports first audio and stalls once every part is done.
+class Message
+{
+public:
+  Message(std::vector<std::unique_ptr<WsTts>> &conns, const std::string &token, std::vector<std::string_view> parts)
+    : conns(conns), token(token), parts(parts.size())
+  {
+    for (auto i = 0u; i < parts.size(); ++i)
+      this->parts[i].text = parts[i];
+    start = Clock::now();
+    dispatch();
+  }
+
+  auto done() const -> bool { return finished == parts.size(); }
+  auto firstAudio() const -> Ms { return parts[0].firstAudio - start; }
+  auto stalls() const -> Ms
+  {
+    auto playedOut = parts[0].firstAudio;
+    Ms ret{};
+    for (const auto &part : parts)
+    {
+      const auto begin = std::max(playedOut, part.firstAudio);
+      ret += begin - playedOut;
+      // 24 kHz 16-bit mono, 48 bytes per ms
+      playedOut = begin + std::chrono::duration_cast<Clock::duration>(Ms{part.bytes / 48.});
+    }
+    return ret;
+  }
+
+private:
+  struct Part
+  {
+    std::string_view text;
+    Clock::time_point firstAudio;
+    size_t bytes = 0;
+  };
+
+  auto dispatch() -> void
+  {
+    for (auto &conn : conns)
+    {
+      if (next == parts.size())
+        return;
+      if (conn->busy())
+        continue;
+      const auto i = next++;
+      conn->synthesize(
+        token,
+        ssml(parts[i].text),
+        [this, i](const char *, size_t sz) {
+          if (parts[i].bytes == 0)
+            parts[i].firstAudio = Clock::now();
+          parts[i].bytes += sz;
+        },
+        [this](long status) {
+          if (status != 200)
+            std::cerr << "synthesis failed: " << status << "\n";
+          ++finished;
+          dispatch();
+        });
+    }
+  }
+
+  std::vector<std::unique_ptr<WsTts>> &conns;
+  const std::string &token;
+  std::vector<Part> parts;
+  Clock::time_point start;
+  size_t next = 0;
+  size_t finished = 0;
+};
+
+int main(int argc, char **argv)
+{
+  const std::string url = argc > 2 ? argv[1] : "http://127.0.0.1:8777/cognitiveservices/websocket/v1";
+  const std::string token = argc > 2 ? argv[2] : "good";
+  curl_global_init(CURL_GLOBAL_ALL);
+  EventLoop loop;
+  std::vector<std::unique_ptr<WsTts>> conns;
+  for (auto i = 0; i < Workers; ++i)
+    conns.push_back(std::make_unique<WsTts>(loop, url));
+
+  const std::string sentences =
+    "Hey everyone, I just got home. That boss fight was insane! How did you dodge the last attack? I would have "
+    "used the bow instead, since it keeps jumping back anyway, but honestly your way looked a lot cooler. Also, "
+    "are we doing the swamp quest tonight or saving it for the weekend stream with the whole squad?";
+  std::vector<std::string_view> texts;
+  for (auto len : {40, 120, 160, 200, 300})
+  {
+    auto text = std::string_view{sentences}.substr(0, len);
+    while (!text.empty() && text.back() != ' ')
+      text.remove_suffix(1);
+    texts.push_back(text.substr(0, text.size() - 1));
+  }
+
+  std::cout << "   len  pieces  first audio (whole)  first audio (pieces)  stalls (pieces)\n";
+  auto row = 0u;
+  auto run = 0;
+  auto whole = Ms{};
+  auto pieces = Ms{};
+  auto stalls = Ms{};
+  std::unique_ptr<Message> msg;
+  auto split = false;
+  std::function<void()> step = [&]() {
+    if (msg)
+    {
+      (split ? pieces : whole) += msg->firstAudio();
+      if (split)
+        stalls += msg->stalls();
+      msg.reset();
+      split = !split;
+      run += split ? 0 : 1;
+    }
+    if (run == Runs)
+    {
+      const auto text = texts[row];
+      std::cout << std::fixed << std::setprecision(0) << std::setw(6) << text.size() << std::setw(8)
+                << splitSentences(text, 40, 120).size() << std::setw(18) << whole.count() / Runs << " ms"
+                << std::setw(19) << pieces.count() / Runs << " ms" << std::setw(14) << stalls.count() / Runs
+                << " ms\n";
+      run = 0;
+      whole = pieces = stalls = {};
+      if (++row == texts.size())
+        exit(0);
+    }
+    const auto text = texts[row];
+    msg = std::make_unique<Message>(
+      conns, token, split ? splitSentences(text, 40, 120) : std::vector<std::string_view>{text});
+  };
+
+  // open every connection first, so neither side pays for a handshake
+  auto warm = 0;
+  for (auto &conn : conns)
+    conn->synthesize(token, ssml("warm up"), [](const char *, size_t) {}, [&](long) { ++warm; });
+  std::function<void()> poll = [&]() {
+    if (warm == Workers && (!msg || msg->done()))
+      step();
+    loop.after(std::chrono::milliseconds{1}, poll);
+  };
+  poll();
+  loop.run();
+}
@@ -0,0 +1,188 @@
+// Times ChatBatch::parse() against the jsoncpp DOM it replaced on a
+// 200-item liveChat/messages page, indented with \u escapes and compact
+// with raw UTF-8, counts what each allocates per poll, and checks both read
+// the same fields. There are no recorded pages in the tree; the page is
+// generated in the full liveChatMessage schema with non-ASCII names, emoji,
+// escapes and long profile URLs.
+//
+//   g++ -O2 -std=c++17 -I.. -I/usr/include/jsoncpp live_chat.cpp ../live_chat.cpp ../alloc_count.cpp -ljsoncpp
+//     -o live_chat
+//   ./live_chat
+#include "alloc_count.hpp"
+#include "live_chat.hpp"
+#include <chrono>
+#include <iostream>
+#include <json/json.h>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+struct DomMsg
+{
+  std::string id;
+  std::string name;
+  std::string msg;
+};
+
+// what chatRes() used to do
+static auto viaDom(const std::string &out, std::string &nextPageToken, int &pollingIntervalMillis) -> std::vector<DomMsg>
+{
+  Json::Value root;
+  std::istringstream ss(out);
+  ss >> root;
+  nextPageToken = root["nextPageToken"].asString();
+  pollingIntervalMillis = root["pollingIntervalMillis"].asInt();
+  std::vector<DomMsg> ret;
+  auto items = root["items"];
+  for (auto i = 0u; i < items.size(); ++i)
+  {
+    auto msg = items[i];
+    ret.push_back(
+      {msg["id"].asString(), msg["authorDetails"]["displayName"].asString(), msg["snippet"]["displayMessage"].asString()});
+  }
+  return ret;
+}
+
+static auto page() -> Json::Value
+{
+  std::mt19937 rng(1);
+  const auto hex = [&](int n) {
+    std::string ret;
+    for (auto i = 0; i < n; ++i)
+      ret += "0123456789abcdef"[rng() % 16];
+    return ret;
+  };
+  const char *names[] = {"Сергей", "たなか", "some_user42", "Zoë ✨", "c0rzi", "🐸 frog fan", "théemperor"};
+  const char *texts[] = {"hello there",
+                         "<script>alert(1)</script> & stuff",
+                         "lol 😂😂😂 \"quoted\" back\\slash",
+                         "check https://example.com/a?b=c&d=e",
+                         "line\nbreak\ttab",
+                         "日本語のメッセージです！",
+                         "@some_user42 GG WP"};
+  Json::Value root;
+  root["kind"] = "youtube#liveChatMessageListResponse";
+  root["etag"] = hex(16);
+  root["pollingIntervalMillis"] = 5083;
+  root["pageInfo"]["totalResults"] = 200;
+  root["pageInfo"]["resultsPerPage"] = 200;
+  root["nextPageToken"] = "GJDc8e3Q_YMDIKKm0_Pd_YMD";
+  root["offlineAt"] = Json::Value::null;
+  for (auto i = 0; i < 200; ++i)
+  {
+    Json::Value item;
+    const auto text = std::string{texts[rng() % std::size(texts)]} + " " + std::to_string(i);
+    item["kind"] = "youtube#liveChatMessage";
+    item["etag"] = hex(17);
+    item["id"] = "LCC." + hex(32);
+    auto &snippet = item["snippet"];
+    snippet["type"] = "textMessageEvent";
+    snippet["liveChatId"] = "Cg0KC2FiY2RlZmdoaWpr";
+    snippet["authorChannelId"] = "UC" + hex(22);
+    snippet["publishedAt"] = "2026-10-17T12:00:00.123456+00:00";
+    snippet["hasDisplayContent"] = true;
+    snippet["displayMessage"] = text;
+    snippet["textMessageDetails"]["messageText"] = text;
+    auto &author = item["authorDetails"];
+    author["channelId"] = "UC" + hex(22);
+    author["channelUrl"] = "http://www.youtube.com/channel/UC" + hex(22);
+    author["displayName"] = names[rng() % std::size(names)];
+    author["profileImageUrl"] = "https://yt4.ggpht.com/ytc/" + std::string(80, 'A') + "=s88-c-k-c0x00ffffff-no-rj";
+    author["isVerified"] = false;
+    author["isChatOwner"] = i == 0;
+    author["isChatSponsor"] = rng() % 2 == 0;
+    author["isChatModerator"] = false;
+    root["items"].append(item);
+  }
+  return root;
+}
+
+// microseconds per call
+template <typename F>
+static auto time(F &&f) -> double
+{
+  auto n = 1;
+  for (;;)
+  {
+    const auto t0 = std::chrono::steady_clock::now();
+    for (auto i = 0; i < n; ++i)
+      f();
+    const auto dt = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    if (dt > 200000)
+      return dt / n;
+    n *= 2;
+  }
+}
+
+int main()
+{
+  const auto root = page();
+  Json::StreamWriterBuilder indented;
+  indented["indentation"] = "  ";
+  indented["emitUTF8"] = false;
+  Json::StreamWriterBuilder compact;
+  compact["indentation"] = "";
+  compact["emitUTF8"] = true;
+  const std::pair<const char *, std::string> pages[] = {{"indented, \\u escapes", Json::writeString(indented, root)},
+                                                        {"compact, raw UTF-8", Json::writeString(compact, root)}};
+
+  auto mismatches = 0;
+  std::cout << "page                            jsoncpp DOM    ChatBatch\n";
+  for (const auto &[name, text] : pages)
+  {
+    std::string token;
+    int interval;
+    auto allocs = allocCount();
+    const auto dom = viaDom(text, token, interval);
+    const auto domAllocs = allocCount() - allocs;
+    ChatBatch batch;
+    auto body = text;
+    allocs = allocCount();
+    batch.parse(body);
+    const auto firstAllocs = allocCount() - allocs;
+    auto same = batch.nextPageToken == token && batch.pollingIntervalMillis == interval && batch.msgs.size() == dom.size();
+    for (auto i = 0u; same && i < dom.size(); ++i)
+      same = batch.msgs[i].id == dom[i].id && batch.msgs[i].name == dom[i].name && batch.msgs[i].msg == dom[i].msg;
+    mismatches += same ? 0 : 1;
+
+    // the next polls, the way main() runs them: curl writes the body into
+    // the buffer parse() handed back, and the batch is cleared once used.
+    // The first poll hands back an empty buffer, so the second one grows it.
+    uint64_t pollAllocs[2];
+    for (auto &n : pollAllocs)
+    {
+      batch.clear();
+      allocs = allocCount();
+      body.assign(text);
+      batch.parse(body);
+      n = allocCount() - allocs;
+    }
+
+    const auto domUs = time([&]() { viaDom(text, token, interval); });
+    // a poll hands its body over and gets the previous buffer back
+    const auto batchUs = time([&]() {
+      body.assign(text);
+      batch.parse(body);
+    });
+    std::cout << "  " << text.size() / 1024 << " KB, " << name << std::string(22 - std::string{name}.size(), ' ')
+              << domUs << " us    " << batchUs << " us" << (same ? "" : "  MISMATCH") << "\n"
+              << "    allocations per poll" << std::string(10, ' ') << domAllocs << std::string(9, ' ') << pollAllocs[1]
+              << " (" << firstAllocs << " first, " << pollAllocs[0] << " second)\n";
+  }
+
+  for (auto bad : {"", "{", "{\"items\":[{\"id\":\"x}]}", "{\"a\":1,}", "{\"a\" 1}", "[1]x", "{\"items\":[]} x"})
+  {
+    std::string body = bad;
+    ChatBatch batch;
+    try
+    {
+      batch.parse(body);
+      std::cout << "no error for malformed " << bad << "\n";
+      ++mismatches;
+    }
+    catch (std::runtime_error &)
+    {
+    }
+  }
+  return mismatches != 0;
+}
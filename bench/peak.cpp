@@ -0,0 +1,101 @@
+// Times the talk and pause checks of the audio threads: absPeak() against
+// a dbToPeak() threshold, and the max_element and logf they replaced, on a
+// 4096-sample capture buffer and on the 2000 samples ttsPaused() looked at,
+// split over the two spans of a ring. absPeak() is checked against a scalar
+// version first, -32768 included.
+//
+//   g++ -O2 -std=c++17 -I.. peak.cpp ../dsp.cpp -o peak && ./peak
+#include "dsp.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+constexpr float TalkThreshold = -12;
+
+// the capture callback before
+static auto oldTalking(const int16_t *pcm, size_t sz) -> bool
+{
+  auto m = std::max_element(pcm, pcm + sz);
+  const auto db = 20 * logf(1.f * *m / 0x8000) / logf(10);
+  return db >= TalkThreshold;
+}
+
+// ttsPaused() before, for one channel with sz samples queued
+static auto oldLoud(const int16_t *a, size_t aSz, const int16_t *b, size_t bSz) -> bool
+{
+  int16_t m = std::numeric_limits<int16_t>::min();
+  if (aSz > 0)
+    m = std::max(m, *std::max_element(a, a + aSz));
+  if (bSz > 0)
+    m = std::max(m, *std::max_element(b, b + bSz));
+  const auto db = 20 * logf(1.f * m / 0x8000) / logf(10);
+  return db >= TalkThreshold;
+}
+
+// nanoseconds per call
+template <typename F>
+static auto time(F &&f) -> double
+{
+  auto n = 1;
+  for (;;)
+  {
+    const auto t0 = std::chrono::steady_clock::now();
+    for (auto i = 0; i < n; ++i)
+      f();
+    const auto dt = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    if (dt > 2e8)
+      return dt / n;
+    n *= 2;
+  }
+}
+
+int main()
+{
+  std::mt19937 rng(1);
+  auto mismatches = 0;
+  for (auto t = 0; t < 10000; ++t)
+  {
+    std::vector<int16_t> v(rng() % 300);
+    for (auto &x : v)
+      x = static_cast<int16_t>(t % 4 == 0 ? -32768 + rng() % 4 : rng());
+    auto ref = 0;
+    for (auto x : v)
+      ref = std::max(ref, std::min(32767, std::abs(static_cast<int>(x))));
+    mismatches += absPeak(v.data(), v.size()) == ref ? 0 : 1;
+  }
+  const auto talkPeak = dbToPeak(TalkThreshold);
+  // the threshold is the smallest peak at or above -12 dBFS
+  mismatches += oldTalking(std::vector<int16_t>{static_cast<int16_t>(talkPeak)}.data(), 1) &&
+                    !oldTalking(std::vector<int16_t>{static_cast<int16_t>(talkPeak - 1)}.data(), 1)
+                  ? 0
+                  : 1;
+  std::cout << mismatches << " mismatches against the scalar peak and the old threshold\n";
+
+  // quiet room noise and voice, the old code reads every sample either way
+  std::normal_distribution<float> noise(0, 1500);
+  std::vector<int16_t> buf(4096);
+  for (auto &x : buf)
+    x = static_cast<int16_t>(std::clamp(noise(rng), -32768.f, 32767.f));
+  volatile auto sink = 0;
+  const auto capOld = time([&]() { sink = sink + oldTalking(buf.data(), 4096); });
+  const auto capNew = time([&]() { sink = sink + (absPeak(buf.data(), 4096) >= talkPeak); });
+  // a ring that wraps 700 samples in
+  const auto pauseOld = time([&]() { sink = sink + oldLoud(buf.data() + 2396, 1300, buf.data(), 700); });
+  const auto pauseNew = time([&]() {
+    sink = sink + (std::max(absPeak(buf.data() + 2396, 1300), absPeak(buf.data(), 700)) >= talkPeak);
+  });
+  std::cout << "ns per call (max_element + logf -> absPeak)\n"
+            << "  capture, 4096 samples: " << capOld << " -> " << capNew << "\n"
+            << "  ttsPaused, 2000 samples in two spans: " << pauseOld << " -> " << pauseNew << "\n";
+
+  // the old code took the largest sample, so a loud negative swing went unheard
+  std::vector<int16_t> negative(4096, -100);
+  negative[1000] = -20000;
+  std::cout << "  -20000 among -100s: old " << (oldTalking(negative.data(), 4096) ? "talking" : "silent")
+            << ", absPeak " << (absPeak(negative.data(), 4096) >= talkPeak ? "talking" : "silent") << "\n";
+  return mismatches != 0;
+}
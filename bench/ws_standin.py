@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+# Stand-in for the Azure speech synthesis WebSocket endpoint, for ws_tts.cpp
+# and first_audio.cpp. Speaks just enough of the protocol for WsTts: the
+# upgrade with "Authorization: Bearer good" (anything else gets a 401),
+# a ping after the upgrade, and per ssml message turn.start, binary audio
+# frames and turn.end. The first audio frame is sent fragmented.
+#
+# The audio for a turn is 48 bytes (1 ms at 24 kHz 16-bit) per
+# --audio-ms-per-char of text outside the SSML tags, filled with the SSML
+# repeated, so clients can check what they got. It starts after
+# --first-audio-ms + --ms-per-char per text character and is paced at
+# --realtime-factor, or sent at once with 0. SSML containing "closeafter"
+# closes the connection after its turn with a close frame, which the client
+# has to echo; if it does not, the next upgrade gets a 500. The token
+# "badaccept" gets a 101 with a wrong Sec-WebSocket-Accept.
+#
+#   python3 ws_standin.py [--port 8777] [--first-audio-ms 0] ...
+import argparse
+import base64
+import hashlib
+import re
+import socket
+import struct
+import threading
+import time
+
+GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+# set while no close frame is waiting for its echo
+close_settled = threading.Event()
+close_settled.set()
+missed_echo = False
+
+
+def recv_exact(c, n):
+    b = b""
+    while len(b) < n:
+        d = c.recv(n - len(b))
+        if not d:
+            raise EOFError
+        b += d
+    return b
+
+
+def read_frame(c):
+    b0, b1 = recv_exact(c, 2)
+    n = b1 & 0x7F
+    if n == 126:
+        n = struct.unpack(">H", recv_exact(c, 2))[0]
+    elif n == 127:
+        n = struct.unpack(">Q", recv_exact(c, 8))[0]
+    assert b1 & 0x80, "client frames must be masked"
+    mask = recv_exact(c, 4)
+    p = bytearray(recv_exact(c, n))
+    for i in range(n):
+        p[i] ^= mask[i % 4]
+    return b0 & 0x0F, bytes(p)
+
+
+def frame(op, p, fin=True):
+    h = bytes([(0x80 if fin else 0) | op])
+    if len(p) < 126:
+        h += bytes([len(p)])
+    elif len(p) < 65536:
+        h += bytes([126]) + struct.pack(">H", len(p))
+    else:
+        h += bytes([127]) + struct.pack(">Q", len(p))
+    return h + p
+
+
+def turn(c, args, rid, ssml):
+    c.sendall(frame(1, b"X-RequestId:" + rid + b"\r\nPath:turn.start\r\n\r\n{}"))
+    chars = len(re.sub(rb"<[^>]*>", b"", ssml).strip())
+    size = 48 * args.audio_ms_per_char * chars
+    audio = (ssml * (size // len(ssml) + 1))[:size]
+    time.sleep((args.first_audio_ms + args.ms_per_char * chars) / 1000)
+    # 100 ms of audio per frame
+    chunk = 4800
+    start = time.monotonic()
+    for i in range(0, len(audio), chunk):
+        if args.realtime_factor > 0:
+            due = start + i / 48 / 1000 / args.realtime_factor
+            time.sleep(max(0, due - time.monotonic()))
+        h = b"X-RequestId:" + rid + b"\r\nContent-Type:audio/x-wav\r\nPath:audio\r\n"
+        msg = struct.pack(">H", len(h)) + h + audio[i : i + chunk]
+        if i == 0:
+            c.sendall(frame(2, msg[:10], fin=False) + frame(0, msg[10:]))
+        else:
+            c.sendall(frame(2, msg))
+    c.sendall(frame(1, b"X-RequestId:" + rid + b"\r\nPath:turn.end\r\n\r\n{}"))
+
+
+def close_with_echo(c):
+    global missed_echo
+    close_settled.clear()
+    c.sendall(frame(8, struct.pack(">H", 1000)))
+    c.settimeout(1)
+    try:
+        while True:
+            op, _ = read_frame(c)
+            if op == 8:
+                break
+    except (EOFError, ConnectionError, socket.timeout):
+        missed_echo = True
+    c.close()
+    close_settled.set()
+
+
+def handle(c, args):
+    global missed_echo
+    c.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    req = b""
+    while b"\r\n\r\n" not in req:
+        d = c.recv(4096)
+        if not d:
+            return
+        req += d
+    lines = req.decode().split("\r\n")[1:]
+    hdrs = dict(l.split(": ", 1) for l in lines if ": " in l)
+    close_settled.wait()
+    if missed_echo:
+        missed_echo = False
+        c.sendall(b"HTTP/1.1 500 No Close Echo\r\nContent-Length: 0\r\n\r\n")
+        c.close()
+        return
+    if hdrs.get("Authorization") not in ("Bearer good", "Bearer badaccept"):
+        c.sendall(b"HTTP/1.1 401 Unauthorized\r\nContent-Length: 0\r\n\r\n")
+        c.close()
+        return
+    key = hdrs["Sec-WebSocket-Key"] + ("x" if hdrs["Authorization"] == "Bearer badaccept" else "")
+    acc = base64.b64encode(hashlib.sha1((key + GUID).encode()).digest()).decode()
+    c.sendall(
+        (
+            "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+            "Sec-WebSocket-Accept: %s\r\n\r\n" % acc
+        ).encode()
+    )
+    c.sendall(frame(9, b"ping"))
+    try:
+        while True:
+            op, p = read_frame(c)
+            if op == 8:
+                return
+            if op != 1:
+                continue
+            head, body = p.split(b"\r\n\r\n", 1)
+            h = dict(l.split(b":", 1) for l in head.split(b"\r\n"))
+            if h[b"Path"].strip() != b"ssml":
+                continue
+            turn(c, args, h[b"X-RequestId"].strip(), body)
+            if b"closeafter" in body:
+                close_with_echo(c)
+                return
+    except (EOFError, ConnectionError):
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--port", type=int, default=8777)
+    parser.add_argument("--first-audio-ms", type=float, default=0)
+    parser.add_argument("--ms-per-char", type=float, default=0)
+    parser.add_argument("--audio-ms-per-char", type=int, default=60)
+    parser.add_argument("--realtime-factor", type=float, default=0)
+    args = parser.parse_args()
+    s = socket.socket()
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    s.bind(("127.0.0.1", args.port))
+    s.listen()
+    while True:
+        c, _ = s.accept()
+        threading.Thread(target=handle, args=(c, args), daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,115 @@
+// Runs WsTts against ws_standin.py: audio split over fragmented frames,
+// connection reuse across turns, reconnect after the server closed with a
+// close frame that has to be echoed, a 401 on a bad token and a failed
+// upgrade on a wrong Sec-WebSocket-Accept. Then times first audio and
+// whole turns on one reused connection against a fresh connection per
+// message.
+//
+//   python3 ws_standin.py &
+//   g++ -O2 -std=c++17 -I.. ws_tts.cpp ../ws_tts.cpp ../ws_conn.cpp ../event_loop.cpp ../http_conn.cpp -lcurl -o ws_tts
+//   ./ws_tts
+#include "ws_tts.hpp"
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <regex>
+
+static const std::string Url = "http://127.0.0.1:8777/cognitiveservices/websocket/v1";
+
+// what the stand-in sends for ssml
+static auto expectedAudio(const std::string &ssml) -> std::string
+{
+  const auto chars = std::regex_replace(ssml, std::regex{"<[^>]*>"}, "").size();
+  std::string ret;
+  while (ret.size() < 48 * 60 * chars)
+    ret += ssml;
+  ret.resize(48 * 60 * chars);
+  return ret;
+}
+
+using Ms = std::chrono::duration<double, std::milli>;
+
+int main()
+{
+  curl_global_init(CURL_GLOBAL_ALL);
+  EventLoop loop;
+  WsTts tts(loop, Url);
+  struct Case
+  {
+    std::string token;
+    std::string ssml;
+    long want;
+  };
+  std::deque<Case> cases = {{"good", "<speak>hello</speak>", 200},
+                            {"good", "<speak>again</speak>", 200},
+                            {"good", "<speak>closeafter</speak>", 200},
+                            {"good", "<speak>after close</speak>", 200},
+                            {"bad", "<speak>x</speak>", 401},
+                            {"badaccept", "<speak>x</speak>", 0},
+                            {"good", "<speak>back</speak>", 200}};
+  auto failed = 0;
+  std::function<void()> timing;
+  std::function<void()> next = [&]() {
+    if (cases.empty())
+    {
+      timing();
+      return;
+    }
+    const auto c = cases.front();
+    cases.pop_front();
+    auto got = std::make_shared<std::string>();
+    tts.synthesize(
+      c.token, c.ssml, [got](const char *data, size_t sz) { got->append(data, sz); }, [&, c, got](long status) {
+        const auto ok = status == c.want && (status != 200 || *got == expectedAudio(c.ssml));
+        failed += ok ? 0 : 1;
+        std::cout << (ok ? "ok   " : "FAIL ") << c.ssml << ", status " << status << "\n";
+        // the stand-in closes after the turn end, give it the time to
+        loop.after(std::chrono::milliseconds{c.ssml.find("closeafter") != std::string::npos ? 100 : 0}, next);
+      });
+  };
+
+  // first audio and turn time in ms, summed over Turns
+  constexpr auto Turns = 50;
+  auto fresh = false;
+  auto left = Turns;
+  Ms firstAudio{};
+  Ms whole{};
+  std::unique_ptr<WsTts> perMessage;
+  std::function<void()> turn = [&]() {
+    if (left-- == 0)
+    {
+      std::cout << (fresh ? "fresh connection per message" : "one reused connection") << ": first audio "
+                << firstAudio.count() / Turns << " ms, turn " << whole.count() / Turns << " ms\n";
+      if (fresh)
+        exit(failed != 0);
+      fresh = true;
+      left = Turns;
+      firstAudio = whole = {};
+      loop.after(std::chrono::milliseconds{0}, turn);
+      return;
+    }
+    if (fresh)
+      perMessage = std::make_unique<WsTts>(loop, Url);
+    auto &t = fresh ? *perMessage : tts;
+    const auto t0 = std::chrono::steady_clock::now();
+    auto first = std::make_shared<bool>(true);
+    t.synthesize(
+      "good",
+      "<speak>a short chat message of about fifty characters</speak>",
+      [&, t0, first](const char *, size_t) {
+        if (*first)
+          firstAudio += std::chrono::steady_clock::now() - t0;
+        *first = false;
+      },
+      [&, t0](long) {
+        whole += std::chrono::steady_clock::now() - t0;
+        // a fresh WsTts is dropped from the loop, not from inside its callback
+        loop.after(std::chrono::milliseconds{0}, turn);
+      });
+  };
+  timing = [&]() { turn(); };
+
+  next();
+  loop.run();
+}
@@ -0,0 +1,350 @@
+#include "clip_store.hpp"
+#include "log/log.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// clips.dat is a sequence of records: header, SSML, PCM, each part padded
+// to 8 bytes; clips.idx is a sequence of (key, record offset) pairs
+static constexpr uint32_t Magic = 0x32434350; // "PCC2"
+
+struct RecordHeader
+{
+  uint32_t magic;
+  uint32_t ssmlSz;
+  uint64_t key;
+  uint64_t pcmSz; // samples
+  uint32_t crc;   // of key, SSML and PCM
+  uint32_t unused;
+};
+
+struct IndexEntry
+{
+  uint64_t key;
+  uint64_t offset;
+};
+
+// CRC-32 (IEEE), eight bytes per step
+static auto crc32(uint32_t crc, const void *data, size_t sz) -> uint32_t
+{
+  static const auto tables = []() {
+    std::array<std::array<uint32_t, 256>, 8> ret;
+    for (auto i = 0u; i < 256; ++i)
+    {
+      auto c = i;
+      for (auto bit = 0; bit < 8; ++bit)
+        c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      ret[0][i] = c;
+    }
+    for (auto i = 0u; i < 256; ++i)
+      for (auto t = 1; t < 8; ++t)
+        ret[t][i] = (ret[t - 1][i] >> 8) ^ ret[0][ret[t - 1][i] & 0xff];
+    return ret;
+  }();
+  auto p = static_cast<const uint8_t *>(data);
+  crc = ~crc;
+  for (; sz >= 8; sz -= 8, p += 8)
+  {
+    uint32_t lo;
+    uint32_t hi;
+    memcpy(&lo, p, 4);
+    memcpy(&hi, p + 4, 4);
+    lo ^= crc;
+    crc = tables[7][lo & 0xff] ^ tables[6][(lo >> 8) & 0xff] ^ tables[5][(lo >> 16) & 0xff] ^ tables[4][lo >> 24] ^
+          tables[3][hi & 0xff] ^ tables[2][(hi >> 8) & 0xff] ^ tables[1][(hi >> 16) & 0xff] ^ tables[0][hi >> 24];
+  }
+  for (; sz > 0; --sz, ++p)
+    crc = tables[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+static auto recordCrc(uint64_t key, std::string_view ssml, const int16_t *pcm, size_t samples) -> uint32_t
+{
+  auto crc = crc32(0, &key, sizeof(key));
+  crc = crc32(crc, ssml.data(), ssml.size());
+  return crc32(crc, pcm, samples * sizeof(int16_t));
+}
+
+static auto pad8(size_t sz) -> size_t
+{
+  return (sz + 7) & ~size_t{7};
+}
+
+static auto writeAll(int fd, const void *data, size_t sz) -> bool
+{
+  auto p = static_cast<const char *>(data);
+  while (sz > 0)
+  {
+    const auto res = ::write(fd, p, sz);
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return false;
+    p += res;
+    sz -= static_cast<size_t>(res);
+  }
+  return true;
+}
+
+ClipStore::ClipStore(std::string dir, size_t capBytes)
+  : dataPath(dir + "/clips.dat"), indexPath(dir + "/clips.idx"), capBytes(capBytes)
+{
+  if (capBytes == 0)
+    return;
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+  {
+    disable("mkdir");
+    return;
+  }
+  if (!open())
+    return;
+  LOG("clip store:", entries.size(), "clips,", dataSz, "bytes");
+}
+
+ClipStore::~ClipStore()
+{
+  close();
+}
+
+auto ClipStore::open() -> bool
+{
+  dataFd = ::open(dataPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (dataFd < 0)
+  {
+    disable("open clips.dat");
+    return false;
+  }
+  struct stat st;
+  if (fstat(dataFd, &st) != 0)
+  {
+    disable("stat clips.dat");
+    return false;
+  }
+  dataSz = static_cast<size_t>(st.st_size);
+  if (!map())
+    return false;
+
+  indexFd = ::open(indexPath.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (indexFd < 0)
+  {
+    disable("open clips.idx");
+    return false;
+  }
+  // later entries are more recent, a key stored twice keeps the last one
+  auto end = uint64_t{};
+  IndexEntry entry;
+  while (::read(indexFd, &entry, sizeof(entry)) == sizeof(entry))
+  {
+    const auto sz = recordSize(entry.offset);
+    if (sz == 0 || reinterpret_cast<const RecordHeader *>(mapping + entry.offset)->key != entry.key ||
+        !intact(entry.offset))
+      continue;
+    entries[entry.key] = Entry{entry.offset, ++useClock};
+    end = std::max(end, entry.offset + sz);
+  }
+  if (entries.empty() && dataSz > 0)
+    return rebuildIndex();
+
+  // anything past the last indexed record is a torn append
+  if (end < dataSz)
+  {
+    if (ftruncate(dataFd, static_cast<off_t>(end)) != 0)
+    {
+      disable("truncate clips.dat");
+      return false;
+    }
+    dataSz = end;
+  }
+  if (dataSz > capBytes)
+    return compact();
+  return true;
+}
+
+auto ClipStore::map() -> bool
+{
+  if (mapping)
+    munmap(const_cast<char *>(mapping), mappingSz);
+  mapping = nullptr;
+  // map the whole cap up front so appends never move the mapping; pages
+  // past the end of the file are never touched
+  mappingSz = std::max(capBytes, dataSz);
+  const auto res = mmap(nullptr, mappingSz, PROT_READ, MAP_SHARED, dataFd, 0);
+  if (res == MAP_FAILED)
+  {
+    disable("mmap clips.dat");
+    return false;
+  }
+  mapping = static_cast<const char *>(res);
+  return true;
+}
+
+auto ClipStore::rebuildIndex() -> bool
+{
+  LOG("clip store: rebuilding", indexPath);
+  std::vector<IndexEntry> index;
+  auto end = uint64_t{};
+  for (size_t offset = 0, sz; (sz = recordSize(offset)) > 0; offset += sz)
+  {
+    // a torn record whose header made it is stepped over
+    if (!intact(offset))
+      continue;
+    const auto key = reinterpret_cast<const RecordHeader *>(mapping + offset)->key;
+    entries[key] = Entry{offset, ++useClock};
+    index.push_back(IndexEntry{key, offset});
+    end = offset + sz;
+  }
+  if (ftruncate(indexFd, 0) != 0 || !writeAll(indexFd, index.data(), index.size() * sizeof(IndexEntry)) ||
+      ftruncate(dataFd, static_cast<off_t>(end)) != 0)
+  {
+    disable("rebuild clips.idx");
+    return false;
+  }
+  dataSz = end;
+  if (dataSz > capBytes)
+    return compact();
+  return true;
+}
+
+auto ClipStore::recordSize(uint64_t offset) const -> size_t
+{
+  if (offset % 8 != 0 || offset + sizeof(RecordHeader) > dataSz)
+    return 0;
+  const auto &header = *reinterpret_cast<const RecordHeader *>(mapping + offset);
+  if (header.magic != Magic || header.pcmSz > dataSz)
+    return 0;
+  const auto sz = sizeof(RecordHeader) + pad8(header.ssmlSz) + pad8(header.pcmSz * sizeof(int16_t));
+  if (offset + sz > dataSz)
+    return 0;
+  return sz;
+}
+
+auto ClipStore::intact(uint64_t offset) const -> bool
+{
+  const auto record = mapping + offset;
+  const auto &header = *reinterpret_cast<const RecordHeader *>(record);
+  const auto text = record + sizeof(RecordHeader);
+  const auto pcm = reinterpret_cast<const int16_t *>(text + pad8(header.ssmlSz));
+  return recordCrc(header.key, {text, header.ssmlSz}, pcm, header.pcmSz) == header.crc;
+}
+
+auto ClipStore::find(uint64_t key, std::string_view ssml) -> Clip
+{
+  const auto iter = entries.find(key);
+  if (iter == std::end(entries))
+    return Clip{};
+  const auto record = mapping + iter->second.offset;
+  const auto &header = *reinterpret_cast<const RecordHeader *>(record);
+  const auto text = record + sizeof(RecordHeader);
+  if (std::string_view{text, header.ssmlSz} != ssml)
+    return Clip{};
+  iter->second.lastUse = ++useClock;
+  return Clip{reinterpret_cast<const int16_t *>(text + pad8(header.ssmlSz)), header.pcmSz};
+}
+
+auto ClipStore::insert(uint64_t key, std::string_view ssml, const std::vector<int16_t> &pcm) -> void
+{
+  if (!mapping)
+    return;
+  const auto sz = sizeof(RecordHeader) + pad8(ssml.size()) + pad8(pcm.size() * sizeof(int16_t));
+  if (sz > capBytes / 2)
+    return;
+  if (dataSz + sz > capBytes && !compact())
+    return;
+
+  std::vector<char> record(sz, 0);
+  const auto crc = recordCrc(key, ssml, pcm.data(), pcm.size());
+  const auto header = RecordHeader{Magic, static_cast<uint32_t>(ssml.size()), key, pcm.size(), crc, 0};
+  memcpy(record.data(), &header, sizeof(header));
+  memcpy(record.data() + sizeof(header), ssml.data(), ssml.size());
+  memcpy(record.data() + sizeof(header) + pad8(ssml.size()), pcm.data(), pcm.size() * sizeof(int16_t));
+  // the data goes first, an index entry never points at a torn record
+  const auto entry = IndexEntry{key, dataSz};
+  if (pwrite(dataFd, record.data(), sz, static_cast<off_t>(dataSz)) != static_cast<ssize_t>(sz) ||
+      !writeAll(indexFd, &entry, sizeof(entry)))
+  {
+    disable("append");
+    return;
+  }
+  entries[key] = Entry{dataSz, ++useClock};
+  dataSz += sz;
+}
+
+auto ClipStore::compact() -> bool
+{
+  std::vector<std::pair<uint64_t, Entry>> live(std::begin(entries), std::end(entries));
+  std::sort(std::begin(live), std::end(live), [](const auto &a, const auto &b) {
+    return a.second.lastUse > b.second.lastUse;
+  });
+
+  const auto tmpDataPath = dataPath + ".tmp";
+  const auto tmpIndexPath = indexPath + ".tmp";
+  const auto tmpData = ::open(tmpDataPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  const auto tmpIndex = ::open(tmpIndexPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  std::unordered_map<uint64_t, Entry> kept;
+  std::vector<IndexEntry> index;
+  auto offset = uint64_t{};
+  auto ok = tmpData >= 0 && tmpIndex >= 0;
+  for (auto iter = std::begin(live); ok && iter != std::end(live); ++iter)
+  {
+    const auto sz = recordSize(iter->second.offset);
+    if (offset + sz > capBytes / 2)
+      continue;
+    ok = writeAll(tmpData, mapping + iter->second.offset, sz);
+    kept[iter->first] = Entry{offset, iter->second.lastUse};
+    index.push_back(IndexEntry{iter->first, offset});
+    offset += sz;
+  }
+  // the index is written in file order, so its order no longer says which
+  // clips are recent; give them the order they were used in instead
+  std::sort(std::begin(index), std::end(index), [&kept](const IndexEntry &a, const IndexEntry &b) {
+    return kept[a.key].lastUse < kept[b.key].lastUse;
+  });
+  ok = ok && writeAll(tmpIndex, index.data(), index.size() * sizeof(IndexEntry));
+  // after a crash between the renames, old index entries that do not match
+  // the new data file are dropped, and with none left the index is rebuilt
+  ok = ok && rename(tmpDataPath.c_str(), dataPath.c_str()) == 0 && rename(tmpIndexPath.c_str(), indexPath.c_str()) == 0;
+  if (!ok)
+  {
+    if (tmpData >= 0)
+      ::close(tmpData);
+    if (tmpIndex >= 0)
+      ::close(tmpIndex);
+    disable("compact");
+    return false;
+  }
+
+  LOG("clip store: compacted", entries.size(), "clips,", dataSz, "bytes to", kept.size(), "clips,", offset, "bytes");
+  ::close(dataFd);
+  ::close(indexFd);
+  dataFd = tmpData;
+  indexFd = tmpIndex;
+  dataSz = offset;
+  entries = std::move(kept);
+  return map();
+}
+
+auto ClipStore::disable(const char *what) -> void
+{
+  LOG("clip store disabled,", what, "failed:", strerror(errno));
+  close();
+  entries.clear();
+  capBytes = 0;
+}
+
+auto ClipStore::close() -> void
+{
+  if (mapping)
+    munmap(const_cast<char *>(mapping), mappingSz);
+  mapping = nullptr;
+  if (dataFd >= 0)
+    ::close(dataFd);
+  if (indexFd >= 0)
+    ::close(indexFd);
+  dataFd = -1;
+  indexFd = -1;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Synthesized clips on disk, keyed like PcmCache, so they survive restarts.
+// Clips are appended to clips.dat and their offsets to clips.idx. The data
+// file is mapped read-only, so a hit is read from the page cache without a
+// read() or a heap copy; playback still copies it into the mixer ring.
+// Nothing is fsync'ed, so a crash can tear any recent record. Each record
+// carries a CRC-32 of its key, SSML and PCM, checked on open, and torn ones
+// are dropped. Once the data file would grow past the cap, the most recently
+// used clips are copied into a fresh file of half the cap.
+class ClipStore
+{
+public:
+  struct Clip
+  {
+    const int16_t *data = nullptr;
+    size_t size = 0;
+  };
+
+  // a cap of 0 disables the store
+  ClipStore(std::string dir, size_t capBytes);
+  ClipStore(const ClipStore &) = delete;
+  ClipStore &operator=(const ClipStore &) = delete;
+  ~ClipStore();
+
+  // points into the mapping, valid until the next insert()
+  auto find(uint64_t key, std::string_view ssml) -> Clip;
+  auto insert(uint64_t key, std::string_view ssml, const std::vector<int16_t> &pcm) -> void;
+
+private:
+  struct Entry
+  {
+    uint64_t offset;
+    uint64_t lastUse;
+  };
+
+  auto open() -> bool;
+  auto map() -> bool;
+  auto rebuildIndex() -> bool;
+  auto compact() -> bool;
+  auto disable(const char *what) -> void;
+  auto close() -> void;
+  // size of the valid record at offset, 0 if there is none
+  auto recordSize(uint64_t offset) const -> size_t;
+  // the record at offset, of a valid size, matches its checksum
+  auto intact(uint64_t offset) const -> bool;
+
+  std::string dataPath;
+  std::string indexPath;
+  size_t capBytes;
+  int dataFd = -1;
+  int indexFd = -1;
+  const char *mapping = nullptr;
+  size_t mappingSz = 0;
+  size_t dataSz = 0;
+  uint64_t useClock = 0;
+  std::unordered_map<uint64_t, Entry> entries;
+};
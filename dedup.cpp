@@ -0,0 +1,264 @@
+#include "dedup.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// The words, interned to ids, as a gap buffer: the words before the gap
+// sit at the front of ids and the rest at its back from tail on. Collapses
+// happen close to one another, so erasing only moves the gap a little
+// instead of shifting everything after it. The front keeps prefix hashes and
+// the back suffix hashes, both stay valid as words move across the gap, and
+// checking whether two word ranges match is O(1). Below HashFrom words a
+// chat message is compared word by word instead, which is cheaper than
+// setting up the hashes for it.
+class Words
+{
+public:
+  static constexpr size_t HashFrom = 256;
+
+  explicit Words(std::vector<uint32_t> ids) : ids(std::move(ids)), tail(0)
+  {
+    const auto n = this->ids.size();
+    if (n < HashFrom)
+      return;
+    pow.assign(n + 1, 1);
+    for (auto i = 0u; i < n; ++i)
+      pow[i + 1] = mul(pow[i], Base);
+    prefix.assign(n + 1, 0);
+    suffix.assign(n + 1, 0);
+    for (auto i = n; i-- > 0;)
+      suffix[i] = add(mul(this->ids[i] + 1, pow[n - 1 - i]), suffix[i + 1]);
+  }
+
+  auto hashed() const -> bool { return !pow.empty(); }
+  auto size() const -> size_t { return gap + ids.size() - tail; }
+  auto operator[](size_t pos) const -> uint32_t { return pos < gap ? ids[pos] : ids[tail + pos - gap]; }
+
+  // the ranges [a, a + len) and [b, b + len) hold the same words, a < b
+  auto same(size_t a, size_t b, size_t len) const -> bool { return scaled(a, len) == mul(scaled(b, len), pow[b - a]); }
+
+  auto erase(size_t pos, size_t count) -> void
+  {
+    moveGap(pos);
+    tail += count;
+  }
+
+private:
+  static constexpr uint64_t Mod = (1ull << 61) - 1;
+  static constexpr uint64_t Base = 1000003;
+
+  static auto mul(uint64_t a, uint64_t b) -> uint64_t
+  {
+    const auto p = static_cast<unsigned __int128>(a) * b;
+    return add(static_cast<uint64_t>(p & Mod), static_cast<uint64_t>(p >> 61));
+  }
+  static auto add(uint64_t a, uint64_t b) -> uint64_t
+  {
+    const auto s = a + b;
+    return s >= Mod ? s - Mod : s;
+  }
+  static auto sub(uint64_t a, uint64_t b) -> uint64_t { return add(a, Mod - b); }
+
+  // The hash of [from, from + len) times Base^(size() - from - len), which
+  // is what the suffix hashes give for the back without a division.
+  auto scaled(size_t from, size_t len) const -> uint64_t
+  {
+    const auto to = from + len;
+    uint64_t ret = 0;
+    if (from < gap)
+    {
+      const auto end = std::min(to, gap);
+      ret = mul(sub(prefix[end], mul(prefix[from], pow[end - from])), pow[size() - end]);
+    }
+    if (to > gap)
+    {
+      const auto begin = std::max(from, gap);
+      ret = add(ret, sub(suffix[tail + begin - gap], suffix[tail + to - gap]));
+    }
+    return ret;
+  }
+
+  auto moveGap(size_t pos) -> void
+  {
+    for (; gap < pos; ++gap, ++tail)
+    {
+      ids[gap] = ids[tail];
+      if (hashed())
+        prefix[gap + 1] = add(mul(prefix[gap], Base), ids[gap] + 1);
+    }
+    while (gap > pos)
+    {
+      ids[--tail] = ids[--gap];
+      if (hashed())
+        suffix[tail] = add(mul(ids[tail] + 1, pow[ids.size() - 1 - tail]), suffix[tail + 1]);
+    }
+  }
+
+  std::vector<uint32_t> ids;
+  size_t gap = 0;
+  size_t tail;
+  std::vector<uint64_t> prefix;
+  std::vector<uint64_t> suffix;
+  std::vector<uint64_t> pow;
+};
+
+// longest len with [a, a + len) == [b, b + len), a < b
+static auto extendForward(const Words &h, size_t a, size_t b, size_t n) -> size_t
+{
+  if (!h.hashed())
+  {
+    size_t len = 0;
+    while (b + len < n && h[a + len] == h[b + len])
+      ++len;
+    return len;
+  }
+  size_t lo = 0;
+  size_t hi = n - b;
+  while (lo < hi)
+  {
+    const auto mid = (lo + hi + 1) / 2;
+    if (h.same(a, b, mid))
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+// longest len with [a - len, a) == [b - len, b), a < b
+static auto extendBackward(const Words &h, size_t a, size_t b) -> size_t
+{
+  if (!h.hashed())
+  {
+    size_t len = 0;
+    while (len < a && h[a - len - 1] == h[b - len - 1])
+      ++len;
+    return len;
+  }
+  size_t lo = 0;
+  size_t hi = a;
+  while (lo < hi)
+  {
+    const auto mid = (lo + hi + 1) / 2;
+    if (h.same(a - mid, b - mid, mid))
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+// Finds the leftmost run of 3+ repeats with period w that starts in
+// [lo, hi). Positions j with word[j] == word[j + w] form stretches; a
+// stretch of length L starting at s means the w-gram at s repeats L / w + 1
+// times. A stretch long enough for three repeats covers at least two
+// multiples of w, so only those anchors are probed.
+static auto findRun(const Words &words, size_t w, size_t lo, size_t hi, size_t &start, size_t &repeats) -> bool
+{
+  const auto n = words.size();
+  const auto end = hi >= n ? n : std::min(n, hi + w);
+  for (size_t a = lo / w * w; a < end && a + w < n; a += w)
+  {
+    if (words[a] != words[a + w])
+      continue;
+    const auto back = extendBackward(words, a, a + w);
+    const auto fwd = extendForward(words, a, a + w, n);
+    const auto len = back + fwd;
+    if (len >= 2 * w)
+    {
+      start = a - back;
+      repeats = len / w + 1;
+      return true;
+    }
+    // skip the anchors inside this stretch
+    a = (a + fwd) / w * w;
+  }
+  return false;
+}
+
+auto dedup(std::string_view var) -> std::string
+{
+  std::vector<std::string_view> words;
+  words.reserve(std::count(std::begin(var), std::end(var), ' ') + 1);
+  for (size_t p0 = 0; p0 < var.size();)
+  {
+    auto p1 = var.find(' ', p0);
+    if (p1 == std::string_view::npos)
+      p1 = var.size();
+    words.push_back(var.substr(p0, p1 - p0));
+    p0 = p1 + 1;
+  }
+
+  std::unordered_map<std::string_view, uint32_t> dict;
+  std::vector<uint32_t> ids;
+  ids.reserve(words.size());
+  for (const auto &word : words)
+  {
+    // emplace() would allocate a node for every word, spam repeats a few
+    auto iter = dict.find(word);
+    if (iter == std::end(dict))
+      iter = dict.emplace(word, static_cast<uint32_t>(dict.size())).first;
+    ids.push_back(iter->second);
+  }
+
+  // Same result as restarting from the smallest period after every
+  // collapse, but each period remembers where a run can still start. A
+  // collapse only creates new runs across its junction, and those start at
+  // most 3 * p words before it, so after the first full scan a small period
+  // only rechecks a window around the junction. Periods above the largest
+  // one scanned so far have not been looked at and need no window.
+  struct Dirty
+  {
+    size_t lo;
+    size_t hi;
+  };
+  std::vector<Dirty> dirty(ids.size() / 2 + 1, Dirty{0, SIZE_MAX});
+  Words text(std::move(ids));
+  size_t top = 0;
+  for (auto w = size_t{1}; w < text.size() / 2;)
+  {
+    top = std::max(top, w);
+    size_t start;
+    size_t repeats;
+    if (dirty[w].lo >= dirty[w].hi || !findRun(text, w, dirty[w].lo, dirty[w].hi, start, repeats))
+    {
+      dirty[w] = {0, 0};
+      ++w;
+      continue;
+    }
+    // nothing starts a run before this one
+    dirty[w].lo = start;
+    const auto junction = start + w;
+    const auto erased = (repeats - 1) * w;
+    text.erase(junction, erased);
+    const auto shift = [&](size_t pos) {
+      if (pos == SIZE_MAX || pos <= junction)
+        return pos;
+      return pos < junction + erased ? junction : pos - erased;
+    };
+    for (auto p = size_t{1}; p <= top && p < text.size() / 2; ++p)
+    {
+      auto &d = dirty[p];
+      const auto lo = junction > 3 * p ? junction - 3 * p : 0;
+      if (d.lo >= d.hi)
+        d = {lo, junction + 1};
+      else
+        d = {std::min(shift(d.lo), lo), std::max(shift(d.hi), junction + 1)};
+    }
+    w = 1;
+  }
+
+  std::vector<std::string_view> byId(dict.size());
+  for (const auto &entry : dict)
+    byId[entry.second] = entry.first;
+  std::string ret;
+  ret.reserve(var.size());
+  for (size_t i = 0; i < text.size(); ++i)
+  {
+    if (!ret.empty())
+      ret += " ";
+    ret += byId[text[i]];
+  }
+  return ret;
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// Collapses runs of three or more repeats of the same word n-gram into one,
+// smallest n-gram and leftmost run first, until nothing repeats. Words are
+// split on single spaces.
+auto dedup(std::string_view) -> std::string;
@@ -0,0 +1,238 @@
+#include "dsp.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DSP_X86 1
+#include <immintrin.h>
+#endif
+
+static auto sat16(int32_t v) -> int16_t
+{
+  return static_cast<int16_t>(std::min<int32_t>(INT16_MAX, std::max<int32_t>(INT16_MIN, v)));
+}
+
+static auto mixS16Scalar(int16_t *acc, const int16_t *src, size_t sz, int16_t gainQ14) -> void
+{
+  for (auto i = 0u; i < sz; ++i)
+    acc[i] = sat16(acc[i] + sat16((src[i] * gainQ14) >> 14));
+}
+
+static auto mixF32Scalar(float *acc, const int16_t *src, size_t sz, float gain) -> void
+{
+  for (auto i = 0u; i < sz; ++i)
+    acc[i] += src[i] * gain;
+}
+
+static auto f32ToS16Scalar(int16_t *out, const float *in, size_t sz) -> void
+{
+  for (auto i = 0u; i < sz; ++i)
+    out[i] = static_cast<int16_t>(std::min(32767.f, std::max(-32768.f, std::nearbyint(in[i]))));
+}
+
+static auto absPeakScalar(const int16_t *data, size_t sz) -> int
+{
+  auto ret = 0;
+  for (auto i = 0u; i < sz; ++i)
+    ret = std::max(ret, std::min(32767, std::abs(static_cast<int>(data[i]))));
+  return ret;
+}
+
+#ifdef DSP_X86
+__attribute__((target("sse2"))) static auto mixS16Sse2(int16_t *acc, const int16_t *src, size_t sz, int16_t gainQ14) -> size_t
+{
+  const auto gain = _mm_set1_epi16(gainQ14);
+  auto i = size_t{};
+  for (; i + 8 <= sz; i += 8)
+  {
+    const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + i));
+    auto s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    if (gainQ14 != UnityGainQ14)
+    {
+      const auto lo = _mm_mullo_epi16(s, gain);
+      const auto hi = _mm_mulhi_epi16(s, gain);
+      const auto p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 14);
+      const auto p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 14);
+      s = _mm_packs_epi32(p0, p1);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(acc + i), _mm_adds_epi16(a, s));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) static auto mixS16Avx2(int16_t *acc, const int16_t *src, size_t sz, int16_t gainQ14) -> size_t
+{
+  const auto gain = _mm256_set1_epi16(gainQ14);
+  auto i = size_t{};
+  for (; i + 16 <= sz; i += 16)
+  {
+    const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc + i));
+    auto s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    if (gainQ14 != UnityGainQ14)
+    {
+      // unpack and pack both work per 128-bit lane, so the order survives
+      const auto lo = _mm256_mullo_epi16(s, gain);
+      const auto hi = _mm256_mulhi_epi16(s, gain);
+      const auto p0 = _mm256_srai_epi32(_mm256_unpacklo_epi16(lo, hi), 14);
+      const auto p1 = _mm256_srai_epi32(_mm256_unpackhi_epi16(lo, hi), 14);
+      s = _mm256_packs_epi32(p0, p1);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + i), _mm256_adds_epi16(a, s));
+  }
+  return i;
+}
+
+__attribute__((target("sse2"))) static auto mixF32Sse2(float *acc, const int16_t *src, size_t sz, float gain) -> size_t
+{
+  const auto g = _mm_set1_ps(gain);
+  auto i = size_t{};
+  for (; i + 8 <= sz; i += 8)
+  {
+    const auto s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    // sign-extend by putting each sample in the high half and shifting back
+    const auto s0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+    const auto s1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+    _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(s0, g)));
+    _mm_storeu_ps(acc + i + 4, _mm_add_ps(_mm_loadu_ps(acc + i + 4), _mm_mul_ps(s1, g)));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) static auto mixF32Avx2(float *acc, const int16_t *src, size_t sz, float gain) -> size_t
+{
+  const auto g = _mm256_set1_ps(gain);
+  auto i = size_t{};
+  for (; i + 8 <= sz; i += 8)
+  {
+    const auto s = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i))));
+    _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), _mm256_mul_ps(s, g)));
+  }
+  return i;
+}
+
+__attribute__((target("sse2"))) static auto f32ToS16Sse2(int16_t *out, const float *in, size_t sz) -> size_t
+{
+  auto i = size_t{};
+  for (; i + 8 <= sz; i += 8)
+  {
+    // cvtps rounds to nearest, packs saturates to int16
+    const auto v0 = _mm_cvtps_epi32(_mm_loadu_ps(in + i));
+    const auto v1 = _mm_cvtps_epi32(_mm_loadu_ps(in + i + 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packs_epi32(v0, v1));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) static auto f32ToS16Avx2(int16_t *out, const float *in, size_t sz) -> size_t
+{
+  auto i = size_t{};
+  for (; i + 16 <= sz; i += 16)
+  {
+    const auto v0 = _mm256_cvtps_epi32(_mm256_loadu_ps(in + i));
+    const auto v1 = _mm256_cvtps_epi32(_mm256_loadu_ps(in + i + 8));
+    // packs works per lane, permute restores sample order
+    const auto packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(v0, v1), 0xd8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), packed);
+  }
+  return i;
+}
+
+__attribute__((target("sse2"))) static auto absPeakSse2(const int16_t *data, size_t sz, int &peak) -> size_t
+{
+  const auto zero = _mm_setzero_si128();
+  auto m = zero;
+  auto i = size_t{};
+  for (; i + 8 <= sz; i += 8)
+  {
+    const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    // saturating negate, -32768 becomes 32767
+    m = _mm_max_epi16(m, _mm_max_epi16(v, _mm_subs_epi16(zero, v)));
+  }
+  alignas(16) int16_t lanes[8];
+  _mm_store_si128(reinterpret_cast<__m128i *>(lanes), m);
+  peak = *std::max_element(lanes, lanes + 8);
+  return i;
+}
+
+__attribute__((target("avx2"))) static auto absPeakAvx2(const int16_t *data, size_t sz, int &peak) -> size_t
+{
+  const auto zero = _mm256_setzero_si256();
+  auto m = zero;
+  auto i = size_t{};
+  for (; i + 16 <= sz; i += 16)
+  {
+    const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    m = _mm256_max_epi16(m, _mm256_max_epi16(v, _mm256_subs_epi16(zero, v)));
+  }
+  alignas(32) int16_t lanes[16];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), m);
+  peak = *std::max_element(lanes, lanes + 16);
+  return i;
+}
+
+static auto hasAvx2() -> bool
+{
+  static const bool ret = __builtin_cpu_supports("avx2");
+  return ret;
+}
+
+static auto hasSse2() -> bool
+{
+  static const bool ret = __builtin_cpu_supports("sse2");
+  return ret;
+}
+#endif
+
+auto mixS16(int16_t *acc, const int16_t *src, size_t sz, int16_t gainQ14) -> void
+{
+  auto i = size_t{};
+#ifdef DSP_X86
+  if (hasAvx2())
+    i = mixS16Avx2(acc, src, sz, gainQ14);
+  else if (hasSse2())
+    i = mixS16Sse2(acc, src, sz, gainQ14);
+#endif
+  mixS16Scalar(acc + i, src + i, sz - i, gainQ14);
+}
+
+auto mixF32(float *acc, const int16_t *src, size_t sz, float gain) -> void
+{
+  auto i = size_t{};
+#ifdef DSP_X86
+  if (hasAvx2())
+    i = mixF32Avx2(acc, src, sz, gain);
+  else if (hasSse2())
+    i = mixF32Sse2(acc, src, sz, gain);
+#endif
+  mixF32Scalar(acc + i, src + i, sz - i, gain);
+}
+
+auto f32ToS16(int16_t *out, const float *in, size_t sz) -> void
+{
+  auto i = size_t{};
+#ifdef DSP_X86
+  if (hasAvx2())
+    i = f32ToS16Avx2(out, in, sz);
+  else if (hasSse2())
+    i = f32ToS16Sse2(out, in, sz);
+#endif
+  f32ToS16Scalar(out + i, in + i, sz - i);
+}
+
+auto absPeak(const int16_t *data, size_t sz) -> int
+{
+  auto i = size_t{};
+  auto peak = 0;
+#ifdef DSP_X86
+  if (hasAvx2())
+    i = absPeakAvx2(data, sz, peak);
+  else if (hasSse2())
+    i = absPeakSse2(data, sz, peak);
+#endif
+  return std::max(peak, absPeakScalar(data + i, sz - i));
+}
+
+auto dbToPeak(float db) -> int
+{
+  return static_cast<int>(std::ceil(0x8000 * std::pow(10.f, db / 20)));
+}
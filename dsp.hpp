@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Sample kernels for the audio threads. Each one has SSE2 and AVX2 versions
+// picked at run time, with a scalar fallback for other CPUs.
+
+constexpr int16_t UnityGainQ14 = 1 << 14;
+
+// acc[i] = saturate(acc[i] + src[i] * gain), gain in Q14
+auto mixS16(int16_t *acc, const int16_t *src, size_t sz, int16_t gainQ14) -> void;
+// acc[i] += src[i] * gain
+auto mixF32(float *acc, const int16_t *src, size_t sz, float gain) -> void;
+// out[i] = saturate(round(in[i]))
+auto f32ToS16(int16_t *out, const float *in, size_t sz) -> void;
+
+// largest |x|, negative peaks included; -32768 counts as 32767
+auto absPeak(const int16_t *data, size_t sz) -> int;
+// the smallest absolute peak at or above a dBFS threshold, so the audio
+// threads compare integers instead of taking a log per buffer
+auto dbToPeak(float db) -> int;
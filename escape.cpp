@@ -0,0 +1,81 @@
+#include "escape.hpp"
+#include "dedup.hpp"
+#include <algorithm>
+#include <cctype>
+
+auto escName(std::string value) -> std::string
+{
+  std::transform(std::begin(value), std::end(value), std::begin(value), [](char ch) {
+    if (ch == '_')
+      return ' ';
+    return ch;
+  });
+  while (!value.empty() && isdigit(value.back()))
+    value.resize(value.size() - 1);
+  if (value == "cmaennche")
+    value = "c-man-uh-she";
+  if (value == "retr0m")
+    value = "retro-m";
+  if (value == "theemperorpalpatine")
+    value = "Emperor Palpa-teen";
+  if (value == "c0rzi")
+    value = "corzi";
+  return value;
+}
+
+auto escapeXml(std::string &out, std::string_view text) -> void
+{
+  for (auto ch : text)
+    switch (ch)
+    {
+    case '&': out += "&amp;"; break;
+    case '\"': out += "&quot;"; break;
+    case '\'': out += "&apos;"; break;
+    case '<': out += "&lt;"; break;
+    case '>': out += "&gt;"; break;
+    default: out += ch; break;
+    }
+}
+
+// Mentions get the spoken form of the name, links are read out as their
+// scheme and everything else is escaped for SSML, all in one forward scan.
+auto escape(const std::string &name, const std::string &data) -> std::string
+{
+  if (name == "tanja_ultramono")
+    return "";
+
+  const auto tokenEnd = [&](size_t pos) { return std::min(data.find(' ', pos), data.size()); };
+  const auto startsWith = [&](size_t pos, std::string_view prefix) {
+    return data.compare(pos, prefix.size(), prefix.data(), prefix.size()) == 0;
+  };
+  std::string buffer;
+  buffer.reserve(data.size() + data.size() / 4);
+  for (size_t pos = 0; pos < data.size();)
+  {
+    if (data[pos] == '@')
+    {
+      const auto p1 = tokenEnd(pos + 1);
+      buffer += '@';
+      escapeXml(buffer, escName(data.substr(pos + 1, p1 - pos - 1)));
+      pos = p1;
+    }
+    else if (startsWith(pos, "http://"))
+    {
+      buffer += "http link";
+      pos = tokenEnd(pos);
+    }
+    else if (startsWith(pos, "https://"))
+    {
+      buffer += "https link";
+      pos = tokenEnd(pos);
+    }
+    else
+    {
+      // copy plain text up to the next character that needs attention
+      const auto p1 = std::min(data.find_first_of("@h&\"'<>", pos + 1), data.size());
+      escapeXml(buffer, std::string_view{data}.substr(pos, p1 - pos));
+      pos = p1;
+    }
+  }
+  return dedup(buffer);
+}
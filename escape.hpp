@@ -0,0 +1,12 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// how a chatter's name is spoken: underscores as spaces, trailing digits
+// dropped, and a few names spelled out
+auto escName(std::string value) -> std::string;
+// appends text with the XML specials escaped
+auto escapeXml(std::string &out, std::string_view text) -> void;
+// the message text for SSML: mentions spoken, links read as their scheme,
+// XML escaped and repeats collapsed with dedup(); empty for muted authors
+auto escape(const std::string &name, const std::string &data) -> std::string;
@@ -0,0 +1,313 @@
+#include "espeak_tts.hpp"
+#include "log/log.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <spawn.h>
+#include <string_view>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// the text of the SSML the text stage builds: tags dropped, entities undone
+static auto ssmlText(const std::string &ssml) -> std::string
+{
+  static const std::pair<std::string_view, char> entities[] = {
+    {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}};
+  std::string ret;
+  ret.reserve(ssml.size());
+  for (size_t pos = 0; pos < ssml.size();)
+  {
+    const auto ch = ssml[pos];
+    if (ch == '<')
+    {
+      pos = std::min(ssml.find('>', pos), ssml.size() - 1) + 1;
+      continue;
+    }
+    if (ch == '&')
+    {
+      const auto rest = std::string_view{ssml}.substr(pos);
+      auto matched = false;
+      for (const auto &entity : entities)
+        if (rest.compare(0, entity.first.size(), entity.first) == 0)
+        {
+          ret += entity.second;
+          pos += entity.first.size();
+          matched = true;
+          break;
+        }
+      if (matched)
+        continue;
+    }
+    ret += ch;
+    ++pos;
+  }
+  return ret;
+}
+
+// "ja-JP-NanamiNeural" -> "ja+f2": the language of the Azure voice, and a
+// variant picked by its name so chatters still sound different from each other
+static auto espeakVoice(const std::string &voice) -> std::string
+{
+  static const char *variants[] = {"m1", "m2", "m3", "m4", "m7", "f1", "f2", "f3", "f4"};
+  std::string lang;
+  std::string region;
+  const auto dash = voice.find('-');
+  for (auto i = 0u; i < std::min(dash, voice.size()); ++i)
+    lang += static_cast<char>(std::tolower(static_cast<unsigned char>(voice[i])));
+  for (auto i = dash + 1; dash != std::string::npos && i < voice.size() && voice[i] != '-'; ++i)
+    region += static_cast<char>(std::tolower(static_cast<unsigned char>(voice[i])));
+  if (lang.empty())
+    lang = "en";
+  if (lang == "en" && (region == "gb" || region == "us"))
+    lang += "-" + region;
+  const auto variant = variants[std::hash<std::string>{}(voice) % (sizeof(variants) / sizeof(*variants))];
+  return lang + "+" + variant;
+}
+
+EspeakTts::EspeakTts(EventLoop &loop, std::string binary) : loop(loop), binary(std::move(binary))
+{
+  // an espeak that dies before reading its text must not take us down with
+  // the write to its stdin
+  signal(SIGPIPE, SIG_IGN);
+}
+
+auto EspeakTts::available(const std::string &binary) -> bool
+{
+  if (binary.find('/') != std::string::npos)
+    return access(binary.c_str(), X_OK) == 0;
+  const auto path = getenv("PATH");
+  for (std::string_view dirs = path ? path : "/usr/local/bin:/usr/bin:/bin"; !dirs.empty();)
+  {
+    const auto end = std::min(dirs.find(':'), dirs.size());
+    const auto dir = dirs.substr(0, end);
+    dirs.remove_prefix(std::min(end + 1, dirs.size()));
+    const auto file = (dir.empty() ? std::string{"."} : std::string{dir}) + "/" + binary;
+    if (access(file.c_str(), X_OK) == 0)
+      return true;
+  }
+  return false;
+}
+
+auto EspeakTts::synthesize(const std::string &voice, const std::string &ssml, OnAudio onAudio, OnDone onDone) -> uint64_t
+{
+  const auto id = ++lastId;
+  auto &s = syntheses[id];
+  s.onAudio = std::move(onAudio);
+  s.onDone = std::move(onDone);
+  const auto fail = [&](const char *what) {
+    LOG(what, strerror(errno));
+    loop.after(std::chrono::milliseconds{0}, [this, id]() {
+      if (syntheses.find(id) != std::end(syntheses))
+        finish(id, false);
+    });
+    return id;
+  };
+
+  int inPipe[2];
+  int outPipe[2];
+  if (pipe2(inPipe, O_CLOEXEC) != 0)
+    return fail("espeak stdin pipe:");
+  if (pipe2(outPipe, O_CLOEXEC) != 0)
+  {
+    close(inPipe[0]);
+    close(inPipe[1]);
+    return fail("espeak stdout pipe:");
+  }
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, inPipe[0], 0);
+  posix_spawn_file_actions_adddup2(&actions, outPipe[1], 1);
+  // espeak gets SIGPIPE back and no blocked signals, so a closed pipe ends it
+  // rather than leaving it to synthesize into nothing
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t sigs;
+  sigemptyset(&sigs);
+  posix_spawnattr_setsigmask(&attr, &sigs);
+  sigaddset(&sigs, SIGPIPE);
+  posix_spawnattr_setsigdefault(&attr, &sigs);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+  const auto v = espeakVoice(voice);
+  const char *argv[] = {binary.c_str(), "-v", v.c_str(), "--stdout", nullptr};
+  const auto err = posix_spawnp(&s.pid, binary.c_str(), &actions, &attr, const_cast<char *const *>(argv), environ);
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  close(inPipe[0]);
+  close(outPipe[1]);
+  if (err != 0)
+  {
+    s.pid = -1;
+    close(inPipe[1]);
+    close(outPipe[0]);
+    errno = err;
+    return fail("cannot start espeak:");
+  }
+
+  // a chat message is far below the pipe buffer, so this does not block
+  const auto text = ssmlText(ssml) + "\n";
+  for (size_t written = 0; written < text.size();)
+  {
+    const auto n = write(inPipe[1], text.data() + written, text.size() - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      break;
+    written += n;
+  }
+  close(inPipe[1]);
+
+  fcntl(outPipe[0], F_SETFL, fcntl(outPipe[0], F_GETFL) | O_NONBLOCK);
+  s.fd = outPipe[0];
+  loop.watch(s.fd, [this, id]() { onReadable(id); });
+  return id;
+}
+
+auto EspeakTts::onReadable(uint64_t id) -> void
+{
+  auto &s = syntheses.at(id);
+  char buf[16384];
+  for (;;)
+  {
+    const auto n = read(s.fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && errno == EAGAIN)
+      return;
+    if (n <= 0)
+    {
+      finish(id, n == 0 && s.inData);
+      return;
+    }
+    if (s.inData)
+    {
+      resample(s, buf, n);
+      continue;
+    }
+    s.header.append(buf, n);
+    if (!parseHeader(s))
+    {
+      if (s.header.size() < 4096)
+        continue;
+      LOG("espeak wrote no WAV header");
+      finish(id, false);
+      return;
+    }
+    if (s.rate <= 0)
+    {
+      LOG("espeak wrote an unexpected WAV format");
+      finish(id, false);
+      return;
+    }
+  }
+}
+
+auto EspeakTts::parseHeader(Synthesis &s) -> bool
+{
+  const auto &h = s.header;
+  const auto u16 = [&](size_t pos) { return static_cast<uint8_t>(h[pos]) | static_cast<uint8_t>(h[pos + 1]) << 8; };
+  const auto u32 = [&](size_t pos) { return static_cast<uint32_t>(u16(pos) | u16(pos + 2) << 16); };
+  if (h.size() < 12)
+    return false;
+  if (h.compare(0, 4, "RIFF") != 0 || h.compare(8, 4, "WAVE") != 0)
+  {
+    s.inData = true;
+    return true;
+  }
+  // chunks after the RIFF header; espeak streams, so the sizes of RIFF and
+  // data are bogus and only the fmt chunk is trusted
+  for (size_t pos = 12; pos + 8 <= h.size();)
+  {
+    const auto sz = u32(pos + 4);
+    if (h.compare(pos, 4, "data") == 0)
+    {
+      s.inData = true;
+      const auto rest = h.substr(pos + 8);
+      s.header.clear();
+      if (s.rate > 0)
+        resample(s, rest.data(), rest.size());
+      return true;
+    }
+    if (pos + 8 + sz > h.size())
+      return false;
+    if (h.compare(pos, 4, "fmt ") == 0 && sz >= 16 && u16(pos + 8) == 1 && u16(pos + 10) == 1 && u16(pos + 22) == 16)
+      s.rate = static_cast<int>(u32(pos + 12));
+    pos += 8 + sz + (sz & 1);
+  }
+  return false;
+}
+
+auto EspeakTts::resample(Synthesis &s, const char *data, size_t sz) -> void
+{
+  s.carry.append(data, sz);
+  const auto samples = s.carry.size() / sizeof(int16_t);
+  const auto oldSz = s.in.size();
+  s.in.resize(oldSz + samples);
+  memcpy(s.in.data() + oldSz, s.carry.data(), samples * sizeof(int16_t));
+  s.carry.erase(0, samples * sizeof(int16_t));
+
+  const auto step = s.rate / 24000.;
+  std::vector<int16_t> out;
+  out.reserve(static_cast<size_t>(s.in.size() / step) + 1);
+  while (s.pos + 1 < s.in.size())
+  {
+    const auto i = static_cast<size_t>(s.pos);
+    const auto frac = s.pos - i;
+    out.push_back(static_cast<int16_t>(std::lround(s.in[i] + (s.in[i + 1] - s.in[i]) * frac)));
+    s.pos += step;
+  }
+  const auto used = std::min(static_cast<size_t>(s.pos), s.in.size());
+  s.in.erase(std::begin(s.in), std::begin(s.in) + used);
+  s.pos -= used;
+  if (!out.empty())
+    s.onAudio(reinterpret_cast<const char *>(out.data()), out.size() * sizeof(int16_t));
+}
+
+auto EspeakTts::finish(uint64_t id, bool ok) -> void
+{
+  auto &s = syntheses.at(id);
+  // after a bad header or a read error espeak may still be talking, and stop()
+  // waits for it on the loop thread
+  if (!ok && s.pid > 0)
+    kill(s.pid, SIGKILL);
+  const auto exited = stop(s);
+  if (ok && !exited)
+    LOG("espeak failed");
+  auto done = std::move(s.onDone);
+  syntheses.erase(id);
+  done(ok && exited ? 200 : 0);
+}
+
+auto EspeakTts::cancel(uint64_t id) -> void
+{
+  const auto iter = syntheses.find(id);
+  if (iter == std::end(syntheses))
+    return;
+  if (iter->second.pid > 0)
+    kill(iter->second.pid, SIGKILL);
+  stop(iter->second);
+  syntheses.erase(iter);
+}
+
+// closes the pipe and reaps the process, true if it exited cleanly
+auto EspeakTts::stop(Synthesis &s) -> bool
+{
+  if (s.fd >= 0)
+  {
+    loop.unwatch(s.fd);
+    close(s.fd);
+    s.fd = -1;
+  }
+  if (s.pid <= 0)
+    return false;
+  auto status = 0;
+  while (waitpid(s.pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  s.pid = -1;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
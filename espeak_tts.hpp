@@ -0,0 +1,53 @@
+#pragma once
+#include "event_loop.hpp"
+#include "tts_backend.hpp"
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+// Offline synthesis with an espeak-ng process per synthesis. Sounds far
+// worse than Azure but needs no network and starts speaking within tens of
+// milliseconds, so it covers for Azure being slow or down. The SSML is
+// reduced to its text, the Azure voice picks the espeak language and one of
+// its variants, and the WAV espeak writes to stdout is read on the loop and
+// resampled to 24 kHz.
+class EspeakTts : public TtsBackend
+{
+public:
+  EspeakTts(EventLoop &, std::string binary);
+
+  // binary is an executable path, or a name found on PATH
+  static auto available(const std::string &binary) -> bool;
+
+  auto synthesize(const std::string &voice, const std::string &ssml, OnAudio, OnDone) -> uint64_t override;
+  auto cancel(uint64_t id) -> void override;
+
+private:
+  struct Synthesis
+  {
+    pid_t pid = -1;
+    int fd = -1; // espeak's stdout
+    OnAudio onAudio;
+    OnDone onDone;
+    std::string header; // WAV header until the data chunk starts
+    bool inData = false;
+    int rate = 0;
+    std::string carry; // odd byte between two reads
+    // linear resampler: input samples not consumed yet, and where the next
+    // output sample falls between them
+    std::vector<int16_t> in;
+    double pos = 0;
+  };
+
+  auto onReadable(uint64_t id) -> void;
+  auto parseHeader(Synthesis &) -> bool;
+  auto resample(Synthesis &, const char *data, size_t sz) -> void;
+  auto finish(uint64_t id, bool ok) -> void;
+  auto stop(Synthesis &) -> bool;
+
+  EventLoop &loop;
+  std::string binary;
+  std::unordered_map<uint64_t, Synthesis> syntheses;
+  uint64_t lastId = 0;
+};
@@ -0,0 +1,138 @@
+#include "event_loop.hpp"
+#include "log/log.hpp"
+#include <stdexcept>
+
+EventLoop::EventLoop() : multi(curl_multi_init())
+{
+  if (!multi)
+    throw std::runtime_error("curl_multi_init error");
+}
+
+EventLoop::~EventLoop()
+{
+  for (auto &transfer : transfers)
+    curl_multi_remove_handle(multi, transfer.first);
+  for (auto curl : connected)
+    curl_multi_remove_handle(multi, curl);
+  curl_multi_cleanup(multi);
+}
+
+auto EventLoop::add(HttpConn &conn, Done done) -> void
+{
+  auto curl = conn.handle();
+  transfers[curl] = Transfer{&conn, std::move(done), false};
+  const auto res = curl_multi_add_handle(multi, curl);
+  if (res != CURLM_OK)
+  {
+    transfers.erase(curl);
+    throw std::runtime_error(std::string{"curl_multi_add_handle error: "} + curl_multi_strerror(res));
+  }
+}
+
+auto EventLoop::connect(HttpConn &conn, Done done) -> void
+{
+  add(conn, std::move(done));
+  transfers[conn.handle()].connectOnly = true;
+}
+
+auto EventLoop::cancel(HttpConn &conn) -> void
+{
+  auto curl = conn.handle();
+  if (transfers.erase(curl) > 0 || connected.erase(curl) > 0)
+    curl_multi_remove_handle(multi, curl);
+}
+
+auto EventLoop::after(Clock::duration delay, std::function<void()> cb) -> void
+{
+  timers.emplace(Clock::now() + delay, std::move(cb));
+}
+
+auto EventLoop::watch(int fd, std::function<void()> cb) -> void
+{
+  fds[fd] = std::move(cb);
+}
+
+auto EventLoop::unwatch(int fd) -> void
+{
+  fds.erase(fd);
+}
+
+auto EventLoop::run() -> void
+{
+  for (;;)
+  {
+    int running = 0;
+    curl_multi_perform(multi, &running);
+
+    int left = 0;
+    while (auto msg = curl_multi_info_read(multi, &left))
+    {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+      auto curl = msg->easy_handle;
+      const auto res = msg->data.result;
+      auto iter = transfers.find(curl);
+      if (iter == std::end(transfers))
+      {
+        curl_multi_remove_handle(multi, curl);
+        continue;
+      }
+      auto transfer = std::move(iter->second);
+      transfers.erase(iter);
+      if (transfer.connectOnly && res == CURLE_OK)
+        connected.insert(curl);
+      else
+        curl_multi_remove_handle(multi, curl);
+      transfer.conn->complete(res);
+      transfer.done(res);
+    }
+
+    runTimers();
+    pollFds();
+  }
+}
+
+auto EventLoop::pollFds() -> void
+{
+  waitFds.clear();
+  for (const auto &fd : fds)
+    waitFds.push_back(curl_waitfd{fd.first, CURL_WAIT_POLLIN, 0});
+  const auto res =
+    curl_multi_poll(multi, waitFds.data(), static_cast<unsigned>(waitFds.size()), pollTimeoutMs(), nullptr);
+  if (res != CURLM_OK)
+  {
+    LOG("curl_multi_poll error:", curl_multi_strerror(res));
+    return;
+  }
+  // a callback may unwatch any fd, including its own
+  for (const auto &waitFd : waitFds)
+  {
+    if ((waitFd.revents & CURL_WAIT_POLLIN) == 0)
+      continue;
+    auto iter = fds.find(waitFd.fd);
+    if (iter == std::end(fds))
+      continue;
+    auto cb = iter->second;
+    cb();
+  }
+}
+
+auto EventLoop::runTimers() -> void
+{
+  const auto now = Clock::now();
+  while (!timers.empty() && timers.begin()->first <= now)
+  {
+    auto cb = std::move(timers.begin()->second);
+    timers.erase(timers.begin());
+    cb();
+  }
+}
+
+auto EventLoop::pollTimeoutMs() const -> int
+{
+  const auto MaxTimeoutMs = 1000;
+  if (timers.empty())
+    return MaxTimeoutMs;
+  const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(timers.begin()->first - Clock::now()).count();
+  return static_cast<int>(std::max<decltype(ms)>(0, std::min<decltype(ms)>(MaxTimeoutMs, ms + 1)));
+}
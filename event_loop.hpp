@@ -0,0 +1,57 @@
+#pragma once
+#include "http_conn.hpp"
+#include <chrono>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Single-threaded loop on top of curl_multi. Chat polls, token refreshes and
+// TTS requests are all in flight at the same time without a thread per
+// request; completion handlers and timers run on the thread calling run().
+class EventLoop
+{
+public:
+  using Clock = std::chrono::steady_clock;
+  using Done = std::function<void(CURLcode)>;
+
+  EventLoop();
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+  ~EventLoop();
+
+  // starts a transfer prepared with HttpConn::reset(), the connection must
+  // not be reused until done is called
+  auto add(HttpConn &, Done) -> void;
+  // for CURLOPT_CONNECT_ONLY transfers: done is called once connected and
+  // the handle stays in the multi handle, which curl needs for
+  // curl_easy_send()/curl_easy_recv() to keep working, until cancel()
+  auto connect(HttpConn &, Done) -> void;
+  // drops a transfer or a connection without calling its done
+  auto cancel(HttpConn &) -> void;
+  auto after(Clock::duration, std::function<void()>) -> void;
+  // calls back on the loop thread whenever fd is readable, until unwatched
+  auto watch(int fd, std::function<void()>) -> void;
+  auto unwatch(int fd) -> void;
+  auto run() -> void;
+
+private:
+  struct Transfer
+  {
+    HttpConn *conn;
+    Done done;
+    bool connectOnly;
+  };
+
+  auto runTimers() -> void;
+  auto pollFds() -> void;
+  auto pollTimeoutMs() const -> int;
+
+  CURLM *multi;
+  std::unordered_map<CURL *, Transfer> transfers;
+  std::unordered_set<CURL *> connected;
+  std::multimap<Clock::time_point, std::function<void()>> timers;
+  std::map<int, std::function<void()>> fds;
+  std::vector<curl_waitfd> waitFds;
+};
@@ -0,0 +1,137 @@
+#include "http_conn.hpp"
+#include "log/log.hpp"
+#include <mutex>
+#include <stdexcept>
+
+// One process-wide cache of DNS entries, TLS sessions and connections, so
+// the YouTube, OAuth and Azure handles warm each other up. Every handle runs
+// on the loop thread. The locks cover DNS and TLS sessions for handles on
+// other threads, but libcurl does not support a shared connection cache used
+// from several threads at once: a handle moved off the loop thread needs a
+// share without CURL_LOCK_DATA_CONNECT.
+class HttpShare
+{
+public:
+  HttpShare() : share(curl_share_init())
+  {
+    if (!share)
+      throw std::runtime_error("curl_share_init error");
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, &lockCb);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, &unlockCb);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+  }
+  HttpShare(const HttpShare &) = delete;
+  HttpShare &operator=(const HttpShare &) = delete;
+  ~HttpShare() { curl_share_cleanup(share); }
+
+  CURLSH *share;
+
+private:
+  static auto lockCb(CURL *, curl_lock_data data, curl_lock_access, void *userp) -> void
+  {
+    static_cast<HttpShare *>(userp)->mutexes[data].lock();
+  }
+  static auto unlockCb(CURL *, curl_lock_data data, void *userp) -> void
+  {
+    static_cast<HttpShare *>(userp)->mutexes[data].unlock();
+  }
+
+  std::mutex mutexes[CURL_LOCK_DATA_LAST];
+};
+
+static auto httpShare() -> CURLSH *
+{
+  static HttpShare share;
+  return share.share;
+}
+
+static auto writeCb(void *contents, size_t sz, size_t nmemb, void *userp) -> size_t
+{
+  auto &str = *static_cast<std::string *>(userp);
+  str.append(static_cast<const char *>(contents), sz * nmemb);
+  return sz * nmemb;
+}
+
+HttpConn::HttpConn(std::string name) : name(std::move(name)), curl(curl_easy_init())
+{
+  if (!curl)
+    throw std::runtime_error("curl_easy_init error");
+}
+
+HttpConn::~HttpConn()
+{
+  curl_slist_free_all(headers);
+  curl_easy_cleanup(curl);
+}
+
+auto HttpConn::reset(const std::string &url) -> CURL *
+{
+  // curl_easy_reset() keeps live connections and the TLS session cache
+  curl_easy_reset(curl);
+  curl_slist_free_all(headers);
+  headers = nullptr;
+  out.clear();
+  sink = nullptr;
+  curl_easy_setopt(curl, CURLOPT_SHARE, httpShare());
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &writeCb);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &out);
+  return curl;
+}
+
+auto HttpConn::setHeaders(const std::vector<std::string> &values) -> void
+{
+  curl_slist_free_all(headers);
+  headers = nullptr;
+  for (const auto &value : values)
+    headers = curl_slist_append(headers, value.c_str());
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+}
+
+auto HttpConn::onData(std::function<void(const char *, size_t)> value) -> void
+{
+  sink = std::move(value);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &dataCb);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
+}
+
+auto HttpConn::dataCb(void *contents, size_t sz, size_t nmemb, void *userp) -> size_t
+{
+  static_cast<HttpConn *>(userp)->sink(static_cast<const char *>(contents), sz * nmemb);
+  return sz * nmemb;
+}
+
+auto HttpConn::perform() -> CURLcode
+{
+  return complete(curl_easy_perform(curl));
+}
+
+auto HttpConn::complete(CURLcode res) -> CURLcode
+{
+  if (res != CURLE_OK)
+  {
+    fprintf(stderr, "%s: transfer failed: %s\n", name.c_str(), curl_easy_strerror(res));
+    return res;
+  }
+  long connects = 0;
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+  if (connects == 0)
+  {
+    ++reused;
+    return res;
+  }
+  opened += connects;
+  LOG(name, "opened a new connection, reused:", reused, "opened:", opened);
+  return res;
+}
+
+auto HttpConn::responseCode() const -> long
+{
+  long codep = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &codep);
+  return codep;
+}
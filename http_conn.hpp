@@ -0,0 +1,42 @@
+#pragma once
+#include <curl/curl.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Long-lived easy handle for one endpoint. libcurl keeps the connection and
+// the TLS session attached to the handle between transfers, so a poll to the
+// same host skips DNS, TCP and TLS handshakes. All handles share one DNS,
+// TLS session and connection cache, so a handle that was idle for a while
+// can pick up a session another handle has warmed.
+class HttpConn
+{
+public:
+  HttpConn(std::string name);
+  HttpConn(const HttpConn &) = delete;
+  HttpConn &operator=(const HttpConn &) = delete;
+  ~HttpConn();
+
+  // drops the options of the previous transfer but keeps the connection
+  auto reset(const std::string &url) -> CURL *;
+  auto setHeaders(const std::vector<std::string> &) -> void;
+  // hands the body to the callback as it arrives instead of collecting it in out
+  auto onData(std::function<void(const char *, size_t)>) -> void;
+  auto perform() -> CURLcode;
+  // bookkeeping after a transfer, perform() and EventLoop call it
+  auto complete(CURLcode) -> CURLcode;
+  auto responseCode() const -> long;
+  auto handle() const -> CURL * { return curl; }
+
+  std::string out;
+  int reused = 0;
+  int opened = 0;
+
+private:
+  static auto dataCb(void *contents, size_t sz, size_t nmemb, void *userp) -> size_t;
+
+  std::string name;
+  CURL *curl;
+  std::function<void(const char *, size_t)> sink;
+  curl_slist *headers = nullptr;
+};
@@ -0,0 +1,73 @@
+#include "id_window.hpp"
+#include <algorithm>
+#include <functional>
+
+IdWindow::IdWindow(size_t capacity, Clock::duration window) : window(window), ring(std::max<size_t>(1, capacity))
+{
+  auto slots = size_t{2};
+  while (slots < 2 * ring.size())
+    slots *= 2;
+  table.assign(slots, 0);
+  mask = slots - 1;
+}
+
+auto IdWindow::hash(std::string_view id) -> uint64_t
+{
+  const auto ret = static_cast<uint64_t>(std::hash<std::string_view>{}(id));
+  return ret == 0 ? 1 : ret;
+}
+
+// slot of hash, or of the free slot where it would go
+auto IdWindow::find(uint64_t hash) const -> size_t
+{
+  auto slot = hash & mask;
+  while (table[slot] != 0 && table[slot] != hash)
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+auto IdWindow::contains(std::string_view id) const -> bool
+{
+  return table[find(hash(id))] != 0;
+}
+
+auto IdWindow::add(std::string_view id) -> bool
+{
+  const auto now = Clock::now();
+  while (count > 0 && now - ring[oldest].added > window)
+    forgetOldest();
+  const auto h = hash(id);
+  if (table[find(h)] != 0)
+    return false;
+  if (count == ring.size())
+    forgetOldest();
+  // the oldest may have moved entries around, so probe again
+  table[find(h)] = h;
+  ring[(oldest + count) % ring.size()] = {h, now};
+  ++count;
+  return true;
+}
+
+auto IdWindow::forgetOldest() -> void
+{
+  auto slot = find(ring[oldest].hash);
+  oldest = (oldest + 1) % ring.size();
+  --count;
+  // backward shift deletion: pull later entries of the probe run into the
+  // hole when their home slot is not between the hole and them
+  for (auto next = (slot + 1) & mask; table[next] != 0; next = (next + 1) & mask)
+  {
+    const auto home = table[next] & mask;
+    if (((next - home) & mask) >= ((next - slot) & mask))
+    {
+      table[slot] = table[next];
+      slot = next;
+    }
+  }
+  table[slot] = 0;
+}
+
+auto IdWindow::memoryBytes() const -> size_t
+{
+  return sizeof(*this) + ring.capacity() * sizeof(Entry) + table.capacity() * sizeof(uint64_t);
+}
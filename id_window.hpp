@@ -0,0 +1,45 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Chat message ids seen recently, in fixed memory. Ids are kept as 64-bit
+// hashes in a ring in the order they were added, and an open addressing
+// table over the same hashes answers lookups. An id is forgotten once it is
+// older than the window or capacity newer ids came after it. Two different
+// ids only collide if their hashes are equal, about n / 2^64 per lookup
+// with n ids remembered.
+class IdWindow
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  IdWindow(size_t capacity, Clock::duration window);
+
+  // remembers id, false if it was already there
+  auto add(std::string_view id) -> bool;
+  auto contains(std::string_view id) const -> bool;
+  auto size() const -> size_t { return count; }
+  // constant, allocated up front
+  auto memoryBytes() const -> size_t;
+
+private:
+  struct Entry
+  {
+    uint64_t hash;
+    Clock::time_point added;
+  };
+
+  static auto hash(std::string_view) -> uint64_t;
+  auto find(uint64_t hash) const -> size_t;
+  auto forgetOldest() -> void;
+
+  Clock::duration window;
+  std::vector<Entry> ring;
+  size_t oldest = 0;
+  size_t count = 0;
+  // 0 marks a free slot, at most half full so probes stay short
+  std::vector<uint64_t> table;
+  size_t mask;
+};
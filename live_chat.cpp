@@ -0,0 +1,337 @@
+#include "live_chat.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Recursive descent over exactly the shape of a liveChat/messages page.
+// Objects hand each key to a callback that either reads the value into its
+// field or skips it; skipping only tracks brackets and strings. Strings
+// without escapes are views into the input, the rest is decoded into
+// decoded, which must have room for all of the input.
+class LiveChatParser
+{
+public:
+  LiveChatParser(std::string_view in, std::string &decoded) : in(in), decoded(decoded) {}
+
+  auto parse(ChatBatch &ret) -> void
+  {
+    object([&](std::string_view key) {
+      if (key == "nextPageToken")
+        string(ret.nextPageToken);
+      else if (key == "pollingIntervalMillis")
+        ret.pollingIntervalMillis = integer();
+      else if (key == "items")
+        array([&]() { item(ret.msgs.emplace_back()); });
+      else
+        skip();
+    });
+    ws();
+    if (pos != in.size())
+      fail();
+  }
+
+private:
+  auto item(Msg &msg) -> void
+  {
+    object([&](std::string_view key) {
+      if (key == "id")
+        string(msg.id);
+      else if (key == "snippet")
+        object([&](std::string_view key) {
+          if (key == "displayMessage")
+            string(msg.msg);
+          else
+            skip();
+        });
+      else if (key == "authorDetails")
+        object([&](std::string_view key) {
+          if (key == "displayName")
+            string(msg.name);
+          else
+            skip();
+        });
+      else
+        skip();
+    });
+  }
+
+  [[noreturn]] auto fail() -> void { throw std::runtime_error("malformed chat json at " + std::to_string(pos)); }
+
+  auto ws() -> void
+  {
+    while (pos < in.size() && (in[pos] == ' ' || in[pos] == '\n' || in[pos] == '\r' || in[pos] == '\t'))
+      ++pos;
+  }
+
+  auto peek() -> char
+  {
+    ws();
+    if (pos >= in.size())
+      fail();
+    return in[pos];
+  }
+
+  auto expect(char ch) -> void
+  {
+    if (peek() != ch)
+      fail();
+    ++pos;
+  }
+
+  template <typename OnKey>
+  auto object(OnKey &&onKey) -> void
+  {
+    if (peek() != '{')
+    {
+      // a field of another type where an object was expected
+      skip();
+      return;
+    }
+    ++pos;
+    if (peek() == '}')
+    {
+      ++pos;
+      return;
+    }
+    for (;;)
+    {
+      if (peek() != '"')
+        fail();
+      std::string_view key;
+      string(key);
+      expect(':');
+      onKey(key);
+      if (peek() == ',')
+      {
+        ++pos;
+        continue;
+      }
+      expect('}');
+      return;
+    }
+  }
+
+  template <typename OnItem>
+  auto array(OnItem &&onItem) -> void
+  {
+    if (peek() != '[')
+    {
+      skip();
+      return;
+    }
+    ++pos;
+    if (peek() == ']')
+    {
+      ++pos;
+      return;
+    }
+    for (;;)
+    {
+      onItem();
+      if (peek() == ',')
+      {
+        ++pos;
+        continue;
+      }
+      expect(']');
+      return;
+    }
+  }
+
+  auto string(std::string_view &out) -> void
+  {
+    out = {};
+    if (peek() != '"')
+    {
+      skip();
+      return;
+    }
+    const auto begin = ++pos;
+    auto end = plainRun();
+    if (end < in.size() && in[end] == '"')
+    {
+      pos = end + 1;
+      out = in.substr(begin, end - begin);
+      return;
+    }
+    const auto from = decoded.size();
+    for (;;)
+    {
+      decoded.append(in.data() + pos, end - pos);
+      pos = end;
+      if (pos >= in.size())
+        fail();
+      if (in[pos++] == '"')
+        break;
+      if (pos >= in.size())
+        fail();
+      switch (const auto ch = in[pos++])
+      {
+      case '"':
+      case '\\':
+      case '/': decoded += ch; break;
+      case 'b': decoded += '\b'; break;
+      case 'f': decoded += '\f'; break;
+      case 'n': decoded += '\n'; break;
+      case 'r': decoded += '\r'; break;
+      case 't': decoded += '\t'; break;
+      case 'u': unicode(); break;
+      default: fail();
+      }
+      end = plainRun();
+    }
+    out = std::string_view{decoded.data() + from, decoded.size() - from};
+  }
+
+  // end of the run from pos up to the next quote or escape
+  auto plainRun() const -> size_t
+  {
+    auto end = pos;
+    while (end < in.size() && in[end] != '"' && in[end] != '\\')
+      ++end;
+    return end;
+  }
+
+  // \uXXXX, with a surrogate pair as two of them, to UTF-8
+  auto unicode() -> void
+  {
+    auto &out = decoded;
+    auto cp = hex4();
+    if (cp >= 0xd800 && cp < 0xdc00)
+    {
+      if (in.substr(pos, 2) != "\\u")
+        fail();
+      pos += 2;
+      const auto low = hex4();
+      if (low < 0xdc00 || low >= 0xe000)
+        fail();
+      cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+    }
+    if (cp < 0x80)
+      out += static_cast<char>(cp);
+    else if (cp < 0x800)
+    {
+      out += static_cast<char>(0xc0 | cp >> 6);
+      out += static_cast<char>(0x80 | (cp & 0x3f));
+    }
+    else if (cp < 0x10000)
+    {
+      out += static_cast<char>(0xe0 | cp >> 12);
+      out += static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+      out += static_cast<char>(0x80 | (cp & 0x3f));
+    }
+    else
+    {
+      out += static_cast<char>(0xf0 | cp >> 18);
+      out += static_cast<char>(0x80 | (cp >> 12 & 0x3f));
+      out += static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+      out += static_cast<char>(0x80 | (cp & 0x3f));
+    }
+  }
+
+  auto hex4() -> uint32_t
+  {
+    if (pos + 4 > in.size())
+      fail();
+    uint32_t ret = 0;
+    for (auto i = 0; i < 4; ++i)
+    {
+      const auto ch = in[pos++];
+      ret <<= 4;
+      if (ch >= '0' && ch <= '9')
+        ret |= ch - '0';
+      else if (ch >= 'a' && ch <= 'f')
+        ret |= ch - 'a' + 10;
+      else if (ch >= 'A' && ch <= 'F')
+        ret |= ch - 'A' + 10;
+      else
+        fail();
+    }
+    return ret;
+  }
+
+  auto integer() -> int
+  {
+    const auto ch = peek();
+    if (ch != '-' && (ch < '0' || ch > '9'))
+    {
+      skip();
+      return 0;
+    }
+    const auto neg = ch == '-';
+    if (neg)
+      ++pos;
+    long long ret = 0;
+    while (pos < in.size() && in[pos] >= '0' && in[pos] <= '9')
+      ret = std::min(ret * 10 + (in[pos++] - '0'), 1ll << 31);
+    // a fraction or exponent is not expected here and is dropped
+    skipScalar();
+    return static_cast<int>(neg ? -ret : std::min(ret, (1ll << 31) - 1));
+  }
+
+  // a number or literal, up to the character that ends it
+  auto skipScalar() -> void
+  {
+    while (pos < in.size() && !strchr(",}] \n\r\t", in[pos]))
+      ++pos;
+  }
+
+  // any value; nested containers are walked by bracket depth alone
+  auto skip() -> void
+  {
+    const auto ch = peek();
+    if (ch != '{' && ch != '[' && ch != '"')
+    {
+      if (ch == ',' || ch == '}' || ch == ']' || ch == ':')
+        fail();
+      skipScalar();
+      return;
+    }
+    auto depth = 0;
+    do
+    {
+      if (pos >= in.size())
+        fail();
+      switch (in[pos++])
+      {
+      case '{':
+      case '[': ++depth; break;
+      case '}':
+      case ']': --depth; break;
+      case '"':
+        for (;; ++pos)
+        {
+          if (pos >= in.size())
+            fail();
+          if (in[pos] == '\\')
+            ++pos;
+          else if (in[pos] == '"')
+            break;
+        }
+        ++pos;
+        break;
+      }
+    } while (depth > 0);
+  }
+
+  std::string_view in;
+  std::string &decoded;
+  size_t pos = 0;
+};
+
+auto ChatBatch::parse(std::string &body) -> void
+{
+  clear();
+  this->body.swap(body);
+  decoded.reserve(this->body.size());
+  LiveChatParser{this->body, decoded}.parse(*this);
+}
+
+auto ChatBatch::clear() -> void
+{
+  nextPageToken = {};
+  pollingIntervalMillis = 0;
+  msgs.clear();
+  body.clear();
+  decoded.clear();
+}
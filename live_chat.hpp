@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+// views into the ChatBatch it came from
+struct Msg
+{
+  std::string_view id;
+  std::string_view name;
+  std::string_view msg;
+};
+
+// One poll's worth of liveChat/messages. The batch owns the response body
+// and a buffer for the strings that had escapes, and every view points into
+// one of the two, so parsing a page allocates nothing per message. Meant to
+// be kept across polls: clear() drops the messages in one go and keeps the
+// capacity for the next page.
+class ChatBatch
+{
+public:
+  // Pulls the few fields the bot reads out of the response in one pass,
+  // without building a DOM: nextPageToken, pollingIntervalMillis and per
+  // item id, authorDetails.displayName and snippet.displayMessage.
+  // Everything else is skipped over unparsed. Takes over body and hands back
+  // the previous buffer in it. Missing fields stay empty; malformed JSON
+  // throws std::runtime_error.
+  auto parse(std::string &body) -> void;
+  auto clear() -> void;
+
+  std::string_view nextPageToken;
+  int pollingIntervalMillis = 0;
+  std::vector<Msg> msgs;
+
+private:
+  std::string body;
+  // decoded strings never get longer than their JSON form, so reserving the
+  // size of the body up front keeps the views into it valid
+  std::string decoded;
+};
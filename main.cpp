@@ -1,15 +1,31 @@
+#include "alloc_count.hpp"
+#include "azure_tts.hpp"
+#include "clip_store.hpp"
 #include "cpptoml/cpptoml.h"
+#include "dsp.hpp"
+#include "escape.hpp"
+#include "espeak_tts.hpp"
+#include "event_loop.hpp"
+#include "http_conn.hpp"
+#include "id_window.hpp"
+#include "live_chat.hpp"
 #include "log/log.hpp"
+#include "mixer.hpp"
+#include "pcm_cache.hpp"
+#include "poll_scheduler.hpp"
+#include "script.hpp"
+#include "sentences.hpp"
 #include "sdlpp/sdlpp.hpp"
-#include <codecvt>
+#include "token_manager.hpp"
+#include "voices.hpp"
+#include <atomic>
 #include <csignal>
 #include <curl/curl.h>
+#include <deque>
 #include <iostream>
 #include <json/json.h>
-#include <locale>
-#include <mutex>
+#include <memory>
 #include <string>
-#include <unordered_set>
 
 static std::string urlEncode(const std::string &val)
 {
@@ -25,14 +41,8 @@ static std::string urlEncode(const std::string &val)
   return ret;
 }
 
-static auto w(void *contents, size_t sz, size_t nmemb, void *userp) -> size_t
-{
-  auto &str = *static_cast<std::string *>(userp);
-  str += std::string{static_cast<const char *>(contents), sz * nmemb};
-  return sz * nmemb;
-};
-
-static auto getAccessToken(const std::string &clientId, const std::string &clientSecret, const std::string &refreshToken) -> std::string
+static auto accessTokenReq(HttpConn &conn, const std::string &clientId, const std::string &clientSecret, const std::string &refreshToken)
+  -> void
 {
   const auto payload = [&]() {
     std::ostringstream ss;
@@ -41,34 +51,21 @@ static auto getAccessToken(const std::string &clientId, const std::string &clien
     return ss.str();
   }();
 
-  auto curl = curl_easy_init();
-  if (!curl)
-    return {};
-  curl_easy_setopt(curl, CURLOPT_URL, "https://oauth2.googleapis.com/token");
-  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload.c_str());
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &w);
-  std::string out;
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&out);
-
-  auto res = curl_easy_perform(curl);
-  if (res != CURLE_OK)
-    fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-
-  curl_easy_cleanup(curl);
+  auto curl = conn.reset("https://oauth2.googleapis.com/token");
+  curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, payload.c_str());
+}
 
+static auto accessTokenRes(const HttpConn &conn) -> Token
+{
   Json::Value root;
-  std::istringstream ss(out);
+  std::istringstream ss(conn.out);
   ss >> root;
 
-  return root["access_token"].asString();
+  return {root["access_token"].asString(), std::chrono::seconds{root.get("expires_in", 3600).asInt()}};
 }
 
-static auto getChatId(const std::string &apiKey, const std::string &accessToken) -> std::string
+static auto getChatId(HttpConn &conn, const std::string &apiKey, const std::string &accessToken) -> std::string
 {
-  auto curl = curl_easy_init();
-  if (!curl)
-    return {};
-
   auto url = [&apiKey]() {
     std::ostringstream ss;
     ss << "https://youtube.googleapis.com/youtube/v3/liveBroadcasts?"
@@ -77,69 +74,36 @@ static auto getChatId(const std::string &apiKey, const std::string &accessToken)
     return ss.str();
   }();
 
-  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  auto curl = conn.reset(url);
   curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
 
-  struct curl_slist *list = NULL;
-
   auto authorization = [&accessToken]() {
     std::ostringstream ss;
     ss << "Authorization: Bearer " << urlEncode(accessToken);
     return ss.str();
   }();
 
-  list = curl_slist_append(list, authorization.c_str());
-  list = curl_slist_append(list, "Accept: application/json");
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &w);
-  std::string out;
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&out);
-
-  auto res = curl_easy_perform(curl);
-  if (res != CURLE_OK)
-    fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-
-  long codep;
-  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &codep);
+  conn.setHeaders({authorization, "Accept: application/json"});
+  conn.perform();
+  const auto codep = conn.responseCode();
   if (codep != 200)
   {
-    curl_easy_cleanup(curl);
-    LOG(codep, ":", out);
+    LOG(codep, ":", conn.out);
     throw std::runtime_error("query token error");
   }
 
-  curl_slist_free_all(list);
-
-  curl_easy_cleanup(curl);
-
   Json::Value root;
-  std::istringstream ss(out);
+  std::istringstream ss(conn.out);
   ss >> root;
   assert(!root["items"].empty());
   return root["items"][0]["snippet"]["liveChatId"].asString();
 }
 
-struct Msg
-{
-  std::string id;
-  std::string name;
-  std::string msg;
-};
-
-struct Msgs
-{
-  std::string nextPageToken;
-  std::vector<Msg> msgs;
-};
-
 enum class NeedReauth {};
 
-static auto chat(const std::string &apiKey, const std::string &accessToken, const std::string &chatId, const std::string &pageToken = "") -> Msgs
+static auto chatReq(HttpConn &conn, const std::string &apiKey, const std::string &accessToken, const std::string &chatId, const std::string &pageToken)
+  -> void
 {
-  auto curl = curl_easy_init();
-  if (!curl)
-    return {};
-
   auto url = [&apiKey, &chatId, &pageToken]() {
     std::ostringstream ss;
     ss << "https://youtube.googleapis.com/youtube/v3/liveChat/messages?liveChatId=" << urlEncode(chatId) << "&part=snippet%2CauthorDetails&"
@@ -147,112 +111,356 @@ static auto chat(const std::string &apiKey, const std::string &accessToken, cons
     return ss.str();
   }();
 
-  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  auto curl = conn.reset(url);
   curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
 
-  struct curl_slist *list = NULL;
-
   auto authorization = [&accessToken]() {
     std::ostringstream ss;
     ss << "Authorization: Bearer " << urlEncode(accessToken);
     return ss.str();
   }();
 
-  list = curl_slist_append(list, authorization.c_str());
-  list = curl_slist_append(list, "Accept: application/json");
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &w);
-  std::string out;
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&out);
-
-  auto res = curl_easy_perform(curl);
-  if (res != CURLE_OK)
-    fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-  long codep;
-  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &codep);
+  conn.setHeaders({authorization, "Accept: application/json"});
+}
+
+static auto chatRes(HttpConn &conn, ChatBatch &batch) -> void
+{
+  const auto codep = conn.responseCode();
   if (codep == 401)
     throw NeedReauth{};
   if (codep != 200)
   {
-    curl_easy_cleanup(curl);
-    LOG(codep, ":", out);
+    LOG(codep, ":", conn.out);
     throw std::runtime_error("query chat message error");
   }
 
-  curl_slist_free_all(list);
+  batch.parse(conn.out);
+}
 
-  curl_easy_cleanup(curl);
+static size_t emptyReadCb(char * /*buffer*/, size_t /*size*/, size_t /*nitems*/, void * /*userdata*/)
+{
+  return 0;
+}
 
-  Json::Value root;
-  std::istringstream ss(out);
-  ss >> root;
+static auto ttsTokenReq(HttpConn &conn, const std::string &azureKey) -> void
+{
+  auto curl = conn.reset("https://eastus.api.cognitive.microsoft.com/sts/v1.0/issuetoken");
+  curl_easy_setopt(curl, CURLOPT_POST, 1L);
+  conn.setHeaders({"Ocp-Apim-Subscription-Key: " + azureKey, "Expect:"});
+  //  curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+  curl_easy_setopt(curl, CURLOPT_READFUNCTION, emptyReadCb);
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, 0L);
+}
 
-  Msgs ret;
-  ret.nextPageToken = root["nextPageToken"].asString();
-  auto items = root["items"];
-  for (auto i = 0U; i < items.size(); ++i)
+static auto base64UrlDecode(const std::string &value) -> std::string
+{
+  std::string ret;
+  uint32_t acc = 0;
+  int bits = 0;
+  for (auto ch : value)
   {
-    auto msg = items[i];
-    ret.msgs.push_back({msg["id"].asString(), msg["authorDetails"]["displayName"].asString(), msg["snippet"]["displayMessage"].asString()});
+    int v;
+    if (ch >= 'A' && ch <= 'Z')
+      v = ch - 'A';
+    else if (ch >= 'a' && ch <= 'z')
+      v = ch - 'a' + 26;
+    else if (ch >= '0' && ch <= '9')
+      v = ch - '0' + 52;
+    else if (ch == '-' || ch == '+')
+      v = 62;
+    else if (ch == '_' || ch == '/')
+      v = 63;
+    else
+      break;
+    acc = (acc << 6) | v;
+    bits += 6;
+    if (bits >= 8)
+    {
+      bits -= 8;
+      ret += static_cast<char>((acc >> bits) & 0xff);
+    }
   }
   return ret;
 }
 
-static size_t emptyReadCb(char * /*buffer*/, size_t /*size*/, size_t /*nitems*/, void * /*userdata*/)
+// Azure does not send expires_in, the lifetime is in the exp claim of the JWT
+static auto jwtExpiresIn(const std::string &jwt) -> std::chrono::seconds
 {
-  return 0;
+  const auto DefaultLifetime = std::chrono::seconds{10 * 60};
+  const auto p0 = jwt.find('.');
+  if (p0 == std::string::npos)
+    return DefaultLifetime;
+  const auto p1 = jwt.find('.', p0 + 1);
+  Json::Value root;
+  Json::Reader reader;
+  if (!reader.parse(base64UrlDecode(jwt.substr(p0 + 1, p1 - p0 - 1)), root) || !root.isMember("exp"))
+    return DefaultLifetime;
+  const auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch());
+  return std::chrono::seconds{root["exp"].asInt64()} - now;
 }
 
-static std::string getTtsToken(const std::string &azureKey)
+static auto ttsTokenRes(const HttpConn &conn) -> Token
 {
-  std::string ret;
-  auto curl = curl_easy_init();
-  if (!curl)
+  const auto codep = conn.responseCode();
+  if (codep != 200)
   {
-    curl_global_cleanup();
-    throw std::runtime_error("curl_easy_init error");
+    LOG(codep, ":", conn.out);
+    throw std::runtime_error("query token error");
   }
 
-  curl_easy_setopt(curl, CURLOPT_URL, "https://eastus.api.cognitive.microsoft.com/sts/v1.0/issuetoken");
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ret);
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, w);
-  curl_easy_setopt(curl, CURLOPT_POST, 1L);
-  struct curl_slist *chunk = NULL;
-  chunk = curl_slist_append(chunk, ("Ocp-Apim-Subscription-Key: " + azureKey).c_str());
-  chunk = curl_slist_append(chunk, "Expect:");
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, chunk);
-  //  curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
-  curl_easy_setopt(curl, CURLOPT_READFUNCTION, emptyReadCb);
-  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, 0L);
-  auto res = curl_easy_perform(curl);
-  if (res != CURLE_OK)
+  return {conn.out, jwtExpiresIn(conn.out)};
+}
+
+constexpr auto PauseSz = 2000;
+
+enum class Lang
+{
+  En,
+  Ru,
+  Ja,
+  Ko,
+  None
+};
+
+static auto detectLang(const std::string &text) -> Lang
+{
+  const auto scripts = detectScripts(text);
+  if (scripts.cyrillic)
+    return Lang::Ru;
+  if (scripts.hangul)
+    return Lang::Ko;
+  // kanji without kana is still more likely Japanese chat than Chinese
+  if (scripts.kana || scripts.han)
+    return Lang::Ja;
+  if (scripts.latin)
+    return Lang::En;
+  return Lang::None;
+}
+
+static std::string getVoice(const VoiceMap::Voices &voicesMap, const std::string &name, Lang lang)
+{
+  const auto iter = voicesMap.find(name);
+  const auto hash = std::hash<std::string>()(name) ^ 1;
+  // a voice from voices.txt wins when it speaks the language of the message
+  const auto ownVoice = [&](const char *lang) {
+    return iter != std::end(voicesMap) && iter->second.compare(0, 3, lang) == 0;
+  };
+
+  if (lang == Lang::Ru)
+  {
+    static const std::array<std::string, 15> voices = {
+      "ru-RU-DariyaNeural",
+      "ru-RU-EkaterinaRUS",
+      "ru-RU-Irina",
+      "ru-RU-DariyaNeural",
+      "ru-RU-EkaterinaRUS",
+      "ru-RU-Irina",
+      "ru-RU-DariyaNeural",
+      "ru-RU-DariyaNeural",
+      "ru-RU-EkaterinaRUS",
+      "ru-RU-EkaterinaRUS",
+      "ru-RU-Pavel",
+      "ru-RU-EkaterinaRUS",
+      "ru-RU-DariyaNeural",
+      "ru-RU-Pavel",
+      "ru-RU-Pavel",
+    };
+
+    return voices[hash % voices.size()];
+  }
+  if (lang == Lang::Ko)
   {
-    curl_easy_cleanup(curl);
-    curl_global_cleanup();
-    throw std::runtime_error("curl_easy_perform() failed"); // curl_easy_strerror(res)
+    if (ownVoice("ko-"))
+      return iter->second;
+    static const std::array<std::string, 3> voices = {
+      "ko-KR-SunHiNeural",
+      "ko-KR-InJoonNeural",
+      "ko-KR-HeamiRUS",
+    };
+
+    return voices[hash % voices.size()];
   }
-  long codep;
-  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &codep);
-  if (codep != 200)
+  if (lang == Lang::Ja)
   {
-    curl_easy_cleanup(curl);
-    LOG(codep, ":", ret);
-    throw std::runtime_error("query token error");
+    if (ownVoice("ja-"))
+      return iter->second;
+    static const std::array<std::string, 5> voices = {
+      "ja-JP-NanamiNeural",
+      "ja-JP-KeitaNeural",
+      "ja-JP-Ayumi",
+      "ja-JP-HarukaRUS",
+      "ja-JP-Ichiro",
+    };
+
+    return voices[hash % voices.size()];
   }
 
-  curl_easy_cleanup(curl);
-  curl_slist_free_all(chunk);
+  static const std::array<std::string, 15> voices = {
+    "en-CA-Linda",
+    "en-AU-HayleyRUS",
+    "en-AU-Catherine",
+    "en-CA-HeatherRUS",
+    "en-CA-Linda",
+    "en-GB-HazelRUS",
+    "en-AU-HayleyRUS",
+    "en-GB-HazelRUS",
+    "en-US-AriaRUS",
+    "en-US-AriaRUS",
+    "en-GB-George",
+    "en-US-ZiraRUS",
+    "en-US-AriaRUS",
+    "en-US-BenjaminRUS",
+    "en-US-Guy24kRUS",
+  };
+
+  //  en-AU-NatashaNeural
+  //  en-CA-ClaraNeural
+  //  en-GB-LibbyNeural
+  //  en-GB-MiaNeural
+  //  en-US-AriaNeural
+  //  en-US-GuyNeural
+
+  if (iter != std::end(voicesMap))
+    return iter->second;
+
+  return voices[hash % voices.size()];
+}
+
+static std::string getDialogLine(const std::string &text, bool isMe)
+{
+  if (isMe)
+    return "";
+  if (text.find("?") != std::string::npos || text.find("!") == 0)
+    return "asked:";
+  if (text.find("!") != std::string::npos)
+    return "yelled:";
+  return "said:";
+}
+
+// What the text stage needs to know about a chatter, built on first sight so
+// a message costs one lookup instead of redoing getVoice() and escName().
+struct AuthorProfile
+{
+  // escName() of the author, escaped for SSML
+  std::string spokenName;
+  // per Lang, resolved on first use
+  std::array<std::string, static_cast<size_t>(Lang::None)> voices;
+  // of the last message that had letters; messages without any keep it
+  Lang lang = Lang::En;
+};
+
+// Text stage state that depends on the messages before, one per pipeline
+// instead of statics so nothing is shared between pipelines.
+class SsmlBuilder
+{
+public:
+  SsmlBuilder(const VoiceMap &voiceMap) : voiceMap(voiceMap) {}
+
+  // Long messages are synthesized a few sentences at a time, so the first
+  // audio only waits for the first piece. Pieces are at least ChunkMin
+  // bytes of escaped text where the sentences allow, and a sentence longer
+  // than ChunkMax is cut at a comma.
+  static constexpr size_t ChunkMin = 40;
+  static constexpr size_t ChunkMax = 120;
+
+  // call in chat order; returns the SSML of the message itself in pieces,
+  // none if nothing is left to say or the author is muted; intro gets the
+  // one of "<name> said:" unless the name is not repeated; all speak with
+  // voice
+  auto build(const std::string &name, const std::string &text, bool isMe, std::string &voice, std::string &intro)
+    -> std::vector<std::string>;
+
+private:
+  auto authorProfile(const VoiceMap::Snapshot &, const std::string &name) -> AuthorProfile &;
+
+  const VoiceMap &voiceMap;
+  std::unordered_map<std::string, AuthorProfile> profiles;
+  uint64_t profilesVersion = 0;
+  std::string lastName;
+};
+
+auto SsmlBuilder::authorProfile(const VoiceMap::Snapshot &voices, const std::string &name) -> AuthorProfile &
+{
+  // regulars are a few hundred names; drifting past this means one-off
+  // visitors, so starting over is cheaper than tracking recency
+  constexpr size_t MaxProfiles = 10000;
+  if (voices.version != profilesVersion)
+  {
+    profiles.clear();
+    profilesVersion = voices.version;
+  }
+  if (profiles.size() >= MaxProfiles && profiles.find(name) == std::end(profiles))
+    profiles.clear();
+  auto res = profiles.try_emplace(name);
+  auto &ret = res.first->second;
+  if (res.second)
+    escapeXml(ret.spokenName, escName(name));
   return ret;
 }
 
-constexpr auto PauseSz = 2000;
-static std::mutex mutex;
+auto SsmlBuilder::build(const std::string &name, const std::string &text, bool isMe, std::string &voice, std::string &intro)
+  -> std::vector<std::string>
+{
+  const auto &voices = voiceMap.get();
+  auto &author = authorProfile(voices, name);
+  const auto lang = detectLang(text);
+  if (lang != Lang::None)
+    author.lang = lang;
+  auto &authorVoice = author.voices[static_cast<size_t>(author.lang)];
+  if (authorVoice.empty())
+    authorVoice = getVoice(voices.voices, name, author.lang);
+  voice = authorVoice;
+
+  // requests are built in chat order, so this still suppresses repeated names
+  // even when the syntheses finish out of order
+  auto supressName = (lastName == name) && !isMe;
+  lastName = name;
+
+  intro.clear();
+  // "*" in voices.txt mutes an author, mostly bots
+  const auto own = voices.voices.find(name);
+  if (voice == "*" || (own != std::end(voices.voices) && own->second == "*"))
+    return {};
+
+  // the intro is the same for every message of a regular, so it is a
+  // separate clip that comes out of the caches
+  const auto ssml = [&](std::string_view content) {
+    return R"(<speak version="1.0" xml:lang="en-us"><voice xml:lang="en-US" name=")" + voice + R"(">)" +
+           std::string{content} + R"(</voice></speak>)";
+  };
+  if (!supressName)
+    intro = ssml(author.spokenName + " " + getDialogLine(text, isMe));
+  const auto body = escape(name, text);
+  std::vector<std::string> ret;
+  for (const auto piece : splitSentences(body, ChunkMin, ChunkMax))
+    ret.push_back(ssml(piece));
+  return ret;
+}
 
 struct Ctx
 {
   static constexpr float TalkThreshold = -12;
-  Ctx(std::string azureKey)
-    : azureKey(std::move(azureKey)),
+  Ctx(EventLoop &loop,
+      std::string azureKey,
+      const std::vector<float> &channelGains,
+      bool floatBus,
+      size_t ttsCacheBytes,
+      const std::string &clipStoreDir,
+      size_t clipStoreBytes,
+      int ttsWorkers,
+      const std::string &backend,
+      const std::string &ttsWsUrl,
+      const std::string &espeakPath,
+      int fallbackMs)
+    : ttsWorkers(std::max(1, ttsWorkers)),
+      fallbackAfter(fallbackMs),
+      loop(loop),
+      azureKey(std::move(azureKey)),
+      voices(loop, "voices.txt"),
+      ssmlBuilder(voices),
+      ttsCache(ttsCacheBytes),
+      clipStore(clipStoreDir, clipStoreBytes),
+      mixer(channelGains, floatBus, talkPeak),
       want([]() {
         SDL_AudioSpec want;
         want.freq = 24000;
@@ -269,470 +477,552 @@ struct Ctx
             &have,
             0,
             [this](Uint8 *stream, int len) {
-              std::lock_guard<std::mutex> guard(mutex);
-              int16_t *s = (int16_t *)stream;
-              if (talking > 0 && ttsPaused())
-              {
-                for (auto i = 0u; i < len / sizeof(int16_t); ++i, ++s)
-                  *s = 0;
-              }
+              // real-time thread: wait-free reads from the ring only
+              auto s = reinterpret_cast<int16_t *>(stream);
+              const auto sz = len / sizeof(int16_t);
+              if (talking.load(std::memory_order_relaxed) > 0 && ttsPaused())
+                std::fill(s, s + sz, 0);
               else
-              {
-                for (auto i = 0u; i < len / sizeof(int16_t); ++i, ++s)
-                  *s = idx < pcm.size() ? pcm[idx++] : 0;
-              }
+                mixer.mix(s, sz);
               return len;
             }),
       capture(nullptr, true, &want, &captureHave, 0, [this](Uint8 *stream, int len) {
-        std::lock_guard<std::mutex> guard(mutex);
-        auto pcm = reinterpret_cast<int16_t *>(stream);
-        auto m = std::max_element(pcm, pcm + len / sizeof(int16_t));
-        const auto db = 20 * logf(1.f * *m / 0x8000) / logf(10);
-        if (db >= TalkThreshold)
+        if (absPeak(reinterpret_cast<const int16_t *>(stream), len / sizeof(int16_t)) >= talkPeak)
           talking = 5;
         else if (talking > 0)
           --talking;
-      })
+      }),
+      ttsToken(loop, "ttsToken", [this](HttpConn &conn) { ttsTokenReq(conn, this->azureKey); }, ttsTokenRes)
   {
     const int count = SDL_GetNumAudioDevices(0);
     for (int i = 0; i < count; ++i)
       std::clog << "Audio device" << i << " " << SDL_GetAudioDeviceName(i, 0) << "\n";
+    const auto haveEspeak = EspeakTts::available(espeakPath);
+    if (backend == "espeak")
+    {
+      if (!haveEspeak)
+        LOG("tts-backend is espeak but", espeakPath, "is not installed");
+      ttsBackend = std::make_unique<EspeakTts>(loop, espeakPath);
+    }
+    else
+    {
+      ttsBackend = std::make_unique<AzureTts>(loop, ttsToken, backend == "websocket" ? ttsWsUrl : "");
+      keepClips = true;
+      // without espeak a slow synthesis is better late than never
+      if (fallbackMs > 0 && !haveEspeak)
+        LOG(espeakPath, "is not installed, no local fallback for Azure");
+      if (fallbackMs > 0 && haveEspeak)
+        fallbackTts = std::make_unique<EspeakTts>(loop, espeakPath);
+    }
     audio.pause(false);
     capture.pause(false);
-    tts("tts", "is running", true);
+    tts(0, "tts", "is running", true);
     // for (int i = 31; i <= 40; ++i)
     //   tts(std::to_string(i) + "_voice", "sample voice", true);
   }
 
-  bool ttsPaused() const
-  {
-    if (pcm.size() - idx < PauseSz)
-      return false;
-    auto m = std::max_element(std::begin(pcm) + idx, std::begin(pcm) + idx + PauseSz);
-    const auto db = 20 * logf(1.f * *m / 0x8000) / logf(10);
-    return db < TalkThreshold;
-  }
+  bool ttsPaused() const { return mixer.paused(PauseSz); }
 
-  auto tts(const std::string &name, const std::string &text, bool isMe) -> void;
+  // seq orders playback, chat messages count up from 1 in the order they
+  // were first seen
+  auto tts(uint64_t seq, const std::string &name, const std::string &text, bool isMe) -> void;
 
+  struct TtsJob
+  {
+    enum class State { Queued, Synthesizing, Done };
+    State state = State::Queued;
+    uint64_t seq = 0;
+    std::string voice;
+    std::string ssml;
+    uint64_t cacheKey = 0;
+    uint64_t synthesis = 0;         // with ttsBackend while in flight
+    uint64_t fallbackSynthesis = 0; // with fallbackTts while in flight
+    bool fellBack = false;          // fallbackTts was asked too
+    bool local = false;             // the audio is fallbackTts's
+    std::string carry;        // odd byte between two chunks
+    std::vector<int16_t> pcm; // received, not yet handed to playback
+    std::vector<int16_t> clip; // everything received, for the cache
+    bool playing = false;
+    bool stored = false; // plays from the clip store instead of pcm
+    uint32_t part = 0;      // order within the message, the intro is 0
+    bool joined = false;    // goes on from the part before without a gap
+    bool continued = false; // the part after joins on
+  };
+
+  auto queueTts(std::unique_ptr<TtsJob>) -> void;
+  auto enqueueTts(std::unique_ptr<TtsJob>) -> void;
+  auto dispatchTts() -> void;
+  auto startTts(TtsJob &) -> void;
+  auto startFallback(TtsJob &) -> void;
+  auto fallBack(uint64_t seq, uint64_t synthesis) -> void;
+  auto ttsDone(TtsJob &, long status) -> void;
+  auto ttsData(TtsJob &, const char *data, size_t sz) -> void;
+  auto releaseTts() -> void;
+  auto releaseChunk(TtsJob &, const int16_t *data, size_t sz, bool last) -> size_t;
+  auto startClip() -> void;
+  auto playChunk(const int16_t *data, size_t sz) -> void;
+  auto pumpAudio() -> void;
+
+  const int talkPeak = dbToPeak(TalkThreshold);
+  const int ttsWorkers; // syntheses in flight at once
+  // without audio by then a synthesis moves to the fallback engine
+  const std::chrono::milliseconds fallbackAfter;
+  EventLoop &loop;
   std::string azureKey;
+  VoiceMap voices;
+  SsmlBuilder ssmlBuilder;
+  PcmCache ttsCache;
+  ClipStore clipStore;
+  Mixer mixer;
   SDL_AudioSpec want;
   SDL_AudioSpec have;
   SDL_AudioSpec captureHave;
   sdl::Audio audio;
   sdl::Audio capture;
-  std::string ttsToken;
-  std::vector<int16_t> pcm;
-  size_t idx = 0;
+  TokenManager ttsToken;
+  std::unique_ptr<TtsBackend> ttsBackend;
+  std::unique_ptr<TtsBackend> fallbackTts; // local engine for when Azure lags, if any
+  // Only Azure clips go into the caches. They are keyed by voice and SSML
+  // alone, so espeak audio kept there would play in place of Azure's.
+  bool keepClips = false;
+  std::deque<std::unique_ptr<TtsJob>> ttsJobs; // sorted by seq
+  int ttsInFlight = 0;
+  size_t clipCh = 0; // mixer channel of the streaming clip
+  bool pumpScheduled = false;
   std::string twitchCh;
-  int talking = 0;
+  std::atomic<int> talking{0};
 };
 
-static bool isRu(const std::string &text)
+auto Ctx::tts(uint64_t seq, const std::string &name, const std::string &text, bool isMe) -> void
 {
-  static std::unordered_set<char16_t> ruChars = {
-    u'\x0410', u'\x0410', u'\x0411', u'\x0412', u'\x0413', u'\x0414', u'\x0415', u'\x0416', u'\x0417', u'\x0418', u'\x0419', u'\x041A', u'\x041B',
-    u'\x041C', u'\x041D', u'\x041E', u'\x041F', u'\x0420', u'\x0421', u'\x0422', u'\x0423', u'\x0424', u'\x0425', u'\x0426', u'\x0427', u'\x0428',
-    u'\x0429', u'\x042A', u'\x042B', u'\x042C', u'\x042D', u'\x042E', u'\x042F', u'\x0430', u'\x0431', u'\x0432', u'\x0433', u'\x0434', u'\x0435',
-    u'\x0436', u'\x0437', u'\x0438', u'\x0439', u'\x043A', u'\x043B', u'\x043C', u'\x043D', u'\x043E', u'\x043F', u'\x0440', u'\x0441', u'\x0442',
-    u'\x0443', u'\x0444', u'\x0445', u'\x0446', u'\x0447', u'\x0448', u'\x0449', u'\x044A', u'\x044B', u'\x044C', u'\x044D', u'\x044E', u'\x044F'};
-
-  std::u16string utf16 = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(text.data());
-
-  return std::count_if(std::begin(utf16), std::end(utf16), [](char16_t ch) { return ruChars.find(ch) != std::end(ruChars); }) > 0;
+  std::string voice;
+  std::string intro;
+  auto pieces = ssmlBuilder.build(name, text, isMe, voice, intro);
+  if (!intro.empty())
+    pieces.insert(std::begin(pieces), std::move(intro));
+  // every part is a clip of its own, synthesized in parallel and cached on
+  // its own, and played back as one
+  for (auto part = 0u; part < pieces.size(); ++part)
+  {
+    auto job = std::make_unique<TtsJob>();
+    job->seq = seq;
+    job->voice = voice;
+    job->ssml = std::move(pieces[part]);
+    job->part = part;
+    job->joined = part > 0;
+    job->continued = part + 1 < pieces.size();
+    queueTts(std::move(job));
+  }
 }
 
-static std::unordered_map<std::string, std::string> loadVoices()
+auto Ctx::queueTts(std::unique_ptr<TtsJob> job) -> void
 {
-  std::unordered_map<std::string, std::string> ret;
-  std::ifstream f("voices.txt");
-  if (!f)
-    LOG("File voices.txt is missing");
-  std::string line;
-  while (std::getline(f, line))
+  job->cacheKey = PcmCache::key(job->voice, job->ssml);
+  const auto cached = ttsCache.find(job->cacheKey, job->ssml);
+  const auto &stats = ttsCache.stats();
+  if ((stats.hits + stats.misses) % 50 == 0)
+    LOG("tts cache hits:",
+        stats.hits,
+        "misses:",
+        stats.misses,
+        "entries:",
+        stats.entries,
+        "bytes:",
+        stats.bytes,
+        "evictions:",
+        stats.evictions,
+        "evicted bytes:",
+        stats.evictedBytes);
+  if (cached)
   {
-    std::istringstream strm(line);
-    std::string name;
-    std::getline(strm, name, '=');
-    std::string voice;
-    std::getline(strm, voice);
-    ret[name] = voice;
+    // plays in chat order like any other clip, without a request
+    job->pcm = *cached;
+    job->state = TtsJob::State::Done;
+    enqueueTts(std::move(job));
+    releaseTts();
+    return;
   }
-  return ret;
+  if (clipStore.find(job->cacheKey, job->ssml).data)
+  {
+    // looked up again when its turn comes, the mapping may move until then
+    job->stored = true;
+    job->state = TtsJob::State::Done;
+    enqueueTts(std::move(job));
+    releaseTts();
+    return;
+  }
+  enqueueTts(std::move(job));
+  dispatchTts();
 }
 
-static volatile bool needVoicesReload = true;
-
-void sigHup(int /*signal*/)
+auto Ctx::enqueueTts(std::unique_ptr<TtsJob> job) -> void
 {
-  needVoicesReload = true;
+  const auto before = [](const TtsJob &a, const TtsJob &b) {
+    return a.seq < b.seq || (a.seq == b.seq && a.part < b.part);
+  };
+  // almost always the newest message, so search from the back
+  auto pos = std::end(ttsJobs);
+  while (pos != std::begin(ttsJobs) && before(*job, **std::prev(pos)))
+    --pos;
+  ttsJobs.insert(pos, std::move(job));
 }
 
-static std::string getVoice(const std::string &name, const std::string &text)
+auto Ctx::dispatchTts() -> void
 {
-  if (!isRu(text))
-  {
-    static std::unordered_map<std::string, std::string> voicesMap;
-    static std::array<std::string, 15> voices = {
-      "en-CA-Linda",
-      "en-AU-HayleyRUS",
-      "en-AU-Catherine",
-      "en-CA-HeatherRUS",
-      "en-CA-Linda",
-      "en-GB-HazelRUS",
-      "en-AU-HayleyRUS",
-      "en-GB-HazelRUS",
-      "en-US-AriaRUS",
-      "en-US-AriaRUS",
-      "en-GB-George",
-      "en-US-ZiraRUS",
-      "en-US-AriaRUS",
-      "en-US-BenjaminRUS",
-      "en-US-Guy24kRUS",
-    };
-
-    if (needVoicesReload)
-    {
-      voicesMap = loadVoices();
-      needVoicesReload = false;
-    }
-
-    //  en-AU-NatashaNeural
-    //  en-CA-ClaraNeural
-    //  en-GB-LibbyNeural
-    //  en-GB-MiaNeural
-    //  en-US-AriaNeural
-    //  en-US-GuyNeural
-
-    auto iter = voicesMap.find(name);
-    if (iter != std::end(voicesMap))
-      return iter->second;
-
-    return voices[(std::hash<std::string>()(name) ^ 1) % voices.size()];
-  }
-  else
+  for (auto &job : ttsJobs)
   {
-    static std::array<std::string, 15> voices = {
-      "ru-RU-DariyaNeural",
-      "ru-RU-EkaterinaRUS",
-      "ru-RU-Irina",
-      "ru-RU-DariyaNeural",
-      "ru-RU-EkaterinaRUS",
-      "ru-RU-Irina",
-      "ru-RU-DariyaNeural",
-      "ru-RU-DariyaNeural",
-      "ru-RU-EkaterinaRUS",
-      "ru-RU-EkaterinaRUS",
-      "ru-RU-Pavel",
-      "ru-RU-EkaterinaRUS",
-      "ru-RU-DariyaNeural",
-      "ru-RU-Pavel",
-      "ru-RU-Pavel",
-    };
-
-    return voices[(std::hash<std::string>()(name) ^ 1) % voices.size()];
+    if (ttsInFlight >= ttsWorkers)
+      return;
+    if (job->state == TtsJob::State::Queued)
+      startTts(*job);
   }
 }
 
-static std::string escName(std::string value)
+auto Ctx::startTts(TtsJob &job) -> void
 {
-  std::transform(std::begin(value), std::end(value), std::begin(value), [](char ch) {
-    if (ch == '_')
-      return ' ';
-    return ch;
-  });
-  while (!value.empty() && isdigit(value.back()))
-    value.resize(value.size() - 1);
-  if (value == "cmaennche")
-    value = "c-man-uh-she";
-  if (value == "retr0m")
-    value = "retro-m";
-  if (value == "theemperorpalpatine")
-    value = "Emperor Palpa-teen";
-  if (value == "c0rzi")
-    value = "corzi";
-  return value;
+  job.state = TtsJob::State::Synthesizing;
+  job.clip.clear();
+  job.fellBack = false;
+  job.local = false;
+  ++ttsInFlight;
+  job.synthesis = ttsBackend->synthesize(
+    job.voice,
+    job.ssml,
+    [this, &job](const char *data, size_t sz) {
+      if (job.fallbackSynthesis)
+      {
+        fallbackTts->cancel(job.fallbackSynthesis);
+        job.fallbackSynthesis = 0;
+      }
+      ttsData(job, data, sz);
+    },
+    [this, &job](long status) {
+      job.synthesis = 0;
+      ttsDone(job, status);
+    });
+  if (fallbackTts)
+    loop.after(fallbackAfter, [this, seq = job.seq, synthesis = job.synthesis]() { fallBack(seq, synthesis); });
 }
 
-static std::string getDialogLine(const std::string &text, bool isMe)
+// Races the local engine against the synthesis in flight; whichever has
+// audio first plays and the other is cancelled.
+auto Ctx::startFallback(TtsJob &job) -> void
 {
-  if (isMe)
-    return "";
-  if (text.find("?") != std::string::npos || text.find("!") == 0)
-    return "asked:";
-  if (text.find("!") != std::string::npos)
-    return "yelled:";
-  return "said:";
+  job.fellBack = true;
+  job.fallbackSynthesis = fallbackTts->synthesize(
+    job.voice,
+    job.ssml,
+    [this, &job](const char *data, size_t sz) {
+      if (job.synthesis)
+      {
+        ttsBackend->cancel(job.synthesis);
+        job.synthesis = 0;
+      }
+      job.local = true;
+      ttsData(job, data, sz);
+    },
+    [this, &job](long status) {
+      job.fallbackSynthesis = 0;
+      ttsDone(job, status);
+    });
 }
 
-static auto eq(const std::vector<std::string> &words, size_t i, size_t j, size_t w)
+auto Ctx::fallBack(uint64_t seq, uint64_t synthesis) -> void
 {
-  if (i + w > words.size())
-    return false;
-  if (j + w > words.size())
-    return false;
-  for (auto k = 0U; k < w; ++k)
-    if (words[i + k] != words[j + k])
-      return false;
-  return true;
+  const auto iter = std::find_if(std::begin(ttsJobs), std::end(ttsJobs), [&](const auto &job) {
+    return job->seq == seq && job->synthesis == synthesis;
+  });
+  if (iter == std::end(ttsJobs))
+    return;
+  auto &job = **iter;
+  // once audio started coming it plays out, whatever the pace
+  if (job.state != TtsJob::State::Synthesizing || job.fellBack || !job.clip.empty() || !job.carry.empty())
+    return;
+  LOG("tts too slow, trying the local engine too");
+  startFallback(job);
 }
 
-static auto dedup(const std::string &var)
+// called as each of the two engines finishes
+auto Ctx::ttsDone(TtsJob &job, long status) -> void
 {
-  std::vector<std::string> words;
-  std::string word;
-  std::istringstream st(var);
-  while (std::getline(st, word, ' '))
-    words.push_back(word);
-  for (bool didUpdate = true; didUpdate;)
+  const auto ok = status == 200;
+  const auto gotAudio = !job.clip.empty() || !job.carry.empty();
+  // the other one may still come through
+  if (!gotAudio && (job.synthesis || job.fallbackSynthesis))
+    return;
+  // Azure turning a request down is final, only an Azure that did not
+  // answer is covered for
+  const auto unavailable = status == 0 || status >= 500;
+  if (unavailable && !gotAudio && fallbackTts && !job.fellBack)
   {
-    didUpdate = false;
-    for (auto w = 1U; w < words.size() / 2 && !didUpdate; ++w)
-      for (auto i = 0U; i < words.size() - w && !didUpdate; ++i)
-        for (auto r = 1U; !didUpdate; ++r)
-          if (!eq(words, i, i + r * w, w))
-          {
-            if (r >= 3)
-            {
-              words.erase(std::begin(words) + i + w, std::begin(words) + i + r * w);
-              didUpdate = true;
-            }
-            else
-              break;
-          }
+    LOG("tts failed, falling back to the local engine");
+    startFallback(job);
+    return;
   }
-  std::string ret;
-  for (const auto &word : words)
+  --ttsInFlight;
+  job.state = TtsJob::State::Done;
+  if (ok && !job.local && keepClips)
   {
-    if (!ret.empty())
-      ret += " ";
-    ret += word;
+    clipStore.insert(job.cacheKey, job.ssml, job.clip);
+    ttsCache.insert(job.cacheKey, job.ssml, std::move(job.clip));
   }
-  return ret;
+  releaseTts();
+  dispatchTts();
 }
 
-static std::string escape(const std::string &name, std::string data)
+auto Ctx::ttsData(TtsJob &job, const char *data, size_t sz) -> void
 {
-  if (name == "tanja_ultramono")
-    return "";
-
-  // escape name
-  size_t p0 = 0;
-  while ((p0 = data.find('@', p0)) != std::string::npos)
-  {
-    ++p0;
-    auto p1 = data.find(' ', p0);
-    data.replace(p0, p1 - p0, escName(data.substr(p0, p1 - p0)));
-  }
+  job.carry.append(data, sz);
+  const auto samples = job.carry.size() / sizeof(int16_t);
+  const auto oldSz = job.pcm.size();
+  job.pcm.resize(oldSz + samples);
+  memcpy(job.pcm.data() + oldSz, job.carry.data(), samples * sizeof(int16_t));
+  job.clip.insert(std::end(job.clip), job.pcm.begin() + oldSz, job.pcm.end());
+  job.carry.erase(0, samples * sizeof(int16_t));
+  if (ttsJobs.front().get() == &job)
+    releaseTts();
+}
 
-  // escape HTML links
-  for (;;)
+auto Ctx::releaseTts() -> void
+{
+  // clips go to playback in chat order no matter which synthesis finished
+  // first, the one at the head streams straight into pcm as it arrives
+  while (!ttsJobs.empty())
   {
+    auto &job = *ttsJobs.front();
+    if (job.stored)
     {
-      auto p0 = data.find("http://");
-      if (p0 != std::string::npos)
-      {
-        auto p1 = data.find(' ', p0);
-        data.replace(p0, p1 - p0, "http link");
-
-        continue;
-      }
-    }
-    {
-      auto p0 = data.find("https://");
-      if (p0 != std::string::npos)
+      job.stored = false;
+      const auto clip = clipStore.find(job.cacheKey, job.ssml);
+      if (!clip.data)
       {
-        auto p1 = data.find(' ', p0);
-        data.replace(p0, p1 - p0, "https link");
-
-        continue;
+        // compacted away while waiting, synthesize it after all
+        job.state = TtsJob::State::Queued;
+        dispatchTts();
+        return;
       }
+      // from the page cache into the mixer ring, no heap copy in between
+      releaseChunk(job, clip.data, clip.size, true);
     }
-    break;
-  }
-
-  // escape for XML
-  std::string buffer;
-  buffer.reserve(data.size());
-  for (size_t pos = 0; pos != data.size(); ++pos)
-  {
-    switch (data[pos])
+    if (!job.pcm.empty())
     {
-    case '&': buffer.append("&amp;"); break;
-    case '\"': buffer.append("&quot;"); break;
-    case '\'': buffer.append("&apos;"); break;
-    case '<': buffer.append("&lt;"); break;
-    case '>': buffer.append("&gt;"); break;
-    default: buffer.append(&data[pos], 1); break;
+      const auto used = releaseChunk(job, job.pcm.data(), job.pcm.size(), job.state == TtsJob::State::Done);
+      job.pcm.erase(std::begin(job.pcm), std::begin(job.pcm) + used);
     }
+    if (job.state != TtsJob::State::Done)
+      return;
+    const auto partMissing = job.continued && !job.playing;
+    ttsJobs.pop_front();
+    if (partMissing && !ttsJobs.empty())
+      ttsJobs.front()->joined = false;
   }
-  return dedup(buffer);
 }
 
-static size_t readTextToPcmCb(char *buffer, size_t size, size_t nitems, void *ctx)
+// Plays what is ready of a clip and returns how many samples are done with.
+// The parts of a message, its intro and its pieces, are separate syntheses
+// with Azure's padding of silence at both ends; a part holds back its quiet
+// tail if another one follows and skips its quiet head if it follows
+// another, so they sound like one message.
+auto Ctx::releaseChunk(TtsJob &job, const int16_t *data, size_t sz, bool last) -> size_t
 {
-  std::string &inStr = *(std::string *)ctx;
-  auto ret = std::min(inStr.size(), size * nitems);
-  std::copy(std::begin(inStr), std::begin(inStr) + ret, buffer);
-  inStr.erase(0, ret);
-  return ret;
-}
-
-static std::vector<int16_t> textToPcm(const std::string &token, const std::string &name, const std::string &text, bool isMe)
-{
-  std::string pcmStr;
-  auto curl = curl_easy_init();
-  if (!curl)
+  static const auto quietPeak = dbToPeak(-50);
+  // keep a few ms of the silence so the words do not run into each other
+  constexpr size_t Margin = 24000 / 50;
+  const auto loud = [](int16_t x) { return x >= quietPeak || x <= -quietPeak; };
+  auto from = size_t{0};
+  auto to = sz;
+  if (job.joined && !job.playing)
   {
-    curl_global_cleanup();
-    throw std::runtime_error("curl_easy_init error");
+    from = static_cast<size_t>(std::find_if(data, data + sz, loud) - data);
+    if (from == sz && !last)
+      return 0;
+    from = from > Margin ? from - Margin : 0;
   }
-
-  curl_easy_setopt(curl, CURLOPT_URL, "https://eastus.tts.speech.microsoft.com/cognitiveservices/v1");
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &pcmStr);
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, w);
-  curl_easy_setopt(curl, CURLOPT_POST, 1L);
-  struct curl_slist *chunk = NULL;
-  chunk = curl_slist_append(chunk, "Accept:");
-  chunk = curl_slist_append(chunk, "User-Agent: curl/7.68.0");
-  chunk = curl_slist_append(chunk, ("Authorization: Bearer " + token).c_str());
-  chunk = curl_slist_append(chunk, "Content-Type: application/ssml+xml");
-  chunk = curl_slist_append(chunk, "X-Microsoft-OutputFormat: raw-24khz-16bit-mono-pcm");
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, chunk);
-
-  const auto voice = getVoice(name, text);
-
-  static std::string lastName;
-  auto supressName = (lastName == name) && !isMe;
-
-  std::string xml = R"(<speak version="1.0" xml:lang="en-us"><voice xml:lang="en-US" name=")" + voice + R"(">)" +
-                    (!supressName ? (escName(name) + " " + getDialogLine(text, isMe) + " ") : "") + escape(name, text) + R"(</voice></speak>)";
-
-  curl_easy_setopt(curl, CURLOPT_READDATA, &xml);
-  curl_easy_setopt(curl, CURLOPT_READFUNCTION, readTextToPcmCb);
-  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(xml.size()));
-  auto res = curl_easy_perform(curl);
-  if (res != CURLE_OK)
+  if (job.continued)
   {
-    curl_easy_cleanup(curl);
-    curl_global_cleanup();
-    throw std::runtime_error("curl_easy_perform() failed"); // curl_easy_strerror(res)
+    while (to > from && !loud(data[to - 1]))
+      --to;
+    if (to == from && !last)
+      return from;
+    to = std::min(sz, to + Margin);
   }
-  long codep;
-  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &codep);
-  if (codep == 401)
-    throw NeedReauth{};
-  if (codep != 200)
+  if (from < to)
   {
-    LOG("http code:", codep);
-    LOG("content:", pcmStr);
-    curl_easy_cleanup(curl);
-    throw std::runtime_error("tts error");
+    if (!job.playing)
+    {
+      if (!job.joined)
+        startClip();
+      job.playing = true;
+    }
+    playChunk(data + from, to - from);
   }
-  lastName = name;
+  return last ? sz : to;
+}
 
-  curl_easy_cleanup(curl);
-  curl_slist_free_all(chunk);
+auto Ctx::startClip() -> void
+{
+  // clips queue up on the first channel, once it has more than 30 seconds
+  // queued they go to the least busy of the other channels and play on top
+  clipCh = 0;
+  if (mixer.backlog(0) > 30 * 24000)
+    for (auto ch = 1u; ch < mixer.channels(); ++ch)
+      if (clipCh == 0 || mixer.backlog(ch) < mixer.backlog(clipCh))
+        clipCh = ch;
+  const std::vector<int16_t> silence(2 * PauseSz, 0);
+  playChunk(silence.data(), silence.size());
+}
 
-  std::vector<int16_t> ret;
-  ret.resize(pcmStr.size() / sizeof(int16_t) + 2 * PauseSz);
-  for (auto i = 0u; i < 2 * PauseSz; ++i)
-    ret[i] = 0;
-  memcpy(ret.data() + 2 * PauseSz, pcmStr.data(), pcmStr.size());
-  return ret;
+auto Ctx::playChunk(const int16_t *data, size_t sz) -> void
+{
+  mixer.write(clipCh, data, sz);
+  pumpAudio();
 }
 
-auto Ctx::tts(const std::string &name, const std::string &text, bool isMe) -> void
+auto Ctx::pumpAudio() -> void
 {
-  for (int i = 0; i < 2; ++i)
-  {
-    bool needAuth = false;
-    try
-    {
-      auto tmpPcm = textToPcm(ttsToken, name, text, isMe);
-      std::lock_guard<std::mutex> guard(mutex);
-      if (idx >= pcm.size())
-      {
-        pcm = std::move(tmpPcm);
-        idx = 0;
-      }
-      else
-      {
-        pcm.erase(std::begin(pcm), std::begin(pcm) + idx);
-        idx = 0;
-        if (pcm.size() > 30 * 24000)
-        {
-          pcm.resize(std::max(tmpPcm.size(), pcm.size()));
-          for (auto i = 0u; i < tmpPcm.size(); ++i)
-            pcm[i + idx] = std::min(32000, std::max(-32000, pcm[i + idx] + tmpPcm[i]));
-        }
-        else
-        {
-          for (auto i = 0u; i < tmpPcm.size(); ++i)
-            pcm.push_back(tmpPcm[i]);
-        }
-      }
-    }
-    catch (NeedReauth)
-    {
-      needAuth = true;
-      std::clog << "401 we need to re-authenticate on Azure TTS\n";
-    }
-    catch (std::exception &e)
-    {
-      LOG(e.what());
-    }
-    if (!needAuth)
-      return;
-    ttsToken = getTtsToken(azureKey);
-  }
-  LOG("giving up to TTS");
+  if (!mixer.pump() || pumpScheduled)
+    return;
+  pumpScheduled = true;
+  loop.after(std::chrono::milliseconds{500}, [this]() {
+    pumpScheduled = false;
+    pumpAudio();
+  });
 }
 
 int main()
 {
+  // VoiceMap reloads voices.txt on SIGHUP through a signalfd, which needs
+  // the signal blocked in every thread, so block it before any is started
+  sigset_t hup;
+  sigemptyset(&hup);
+  sigaddset(&hup, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &hup, nullptr);
+
   curl_global_init(CURL_GLOBAL_ALL);
   sdl::Init sdl(SDL_INIT_AUDIO);
 
-  std::signal(SIGHUP, sigHup);
-
   const auto toml = cpptoml::parse_file("credentials.toml");
   const auto refreshToken = toml->get_as<std::string>("refresh-token").value_or("");
   const auto clientId = toml->get_as<std::string>("client-id").value_or("");
   const auto clientSecret = toml->get_as<std::string>("client-secret").value_or("");
   const auto apiKey = toml->get_as<std::string>("api-key").value_or("");
   const auto azureKey = toml->get_as<std::string>("azure-key").value_or("");
-  auto accessToken = getAccessToken(clientId, clientSecret, refreshToken);
-  const auto chatId = getChatId(apiKey, accessToken);
-
-  Ctx ctx(azureKey);
-
+  // liveChatMessages.list costs 5 units, 3000/h matches the old fixed 6 s poll
+  const auto pollQuotaPerHour = toml->get_as<double>("poll-quota-per-hour").value_or(3000);
+  // channel 0 plays clips one after another, the rest take overflow on top
+  const auto voiceChannels = toml->get_as<int>("voice-channels").value_or(2);
+  const auto channelGains = [&]() {
+    std::vector<float> ret;
+    const auto gains = toml->get_array_of<double>("channel-gains");
+    for (auto ch = 0; ch < std::max(1, voiceChannels); ++ch)
+    {
+      const auto gain = gains && ch < static_cast<int>(gains->size()) ? static_cast<float>((*gains)[ch]) : 1.f;
+      ret.push_back(std::min(Mixer::MaxGain, std::max(0.f, gain)));
+      if (ret.back() != gain)
+        LOG("channel-gains:", gain, "for channel", ch, "is out of range, using", ret.back());
+    }
+    return ret;
+  }();
+  const auto floatBus = toml->get_as<bool>("float-bus").value_or(false);
+  // syntheses in flight at once, clips still play in chat order
+  const auto ttsWorkers = toml->get_as<int>("tts-workers").value_or(4);
+  // "rest" makes a request per message, "websocket" keeps a connection per
+  // worker open and streams every message over it, "espeak" stays offline
+  const auto ttsBackend = toml->get_as<std::string>("tts-backend").value_or("rest");
+  const auto ttsWsUrl = toml->get_as<std::string>("tts-ws-url")
+                          .value_or("https://eastus.tts.speech.microsoft.com/cognitiveservices/websocket/v1");
+  const auto espeakPath = toml->get_as<std::string>("espeak-path").value_or("espeak-ng");
+  // Azure syntheses without audio after this long race espeak, the first
+  // to have audio plays; ones that fail because Azure is unreachable or
+  // returns a 5xx are redone with espeak, other errors are not; 0 turns
+  // both off
+  const auto ttsFallbackMs = toml->get_as<int>("tts-fallback-ms").value_or(2500);
+  // synthesized clips kept in memory for lines chat repeats
+  const auto ttsCacheMb = toml->get_as<int>("tts-cache-mb").value_or(64);
+  // and on disk, so they survive restarts
+  const auto clipStoreDir = toml->get_as<std::string>("clip-store-dir").value_or("tts-cache");
+  const auto clipStoreMb = toml->get_as<int>("clip-store-mb").value_or(256);
+  HttpConn youtubeConn("liveBroadcasts");
+  EventLoop loop;
+  TokenManager accessToken(
+    loop,
+    "oauth",
+    [&](HttpConn &conn) { accessTokenReq(conn, clientId, clientSecret, refreshToken); },
+    accessTokenRes);
+  accessToken.fetchNow();
+  const auto chatId = getChatId(youtubeConn, apiKey, accessToken.get());
+
+  Ctx ctx(loop,
+          azureKey,
+          channelGains,
+          floatBus,
+          static_cast<size_t>(std::max(0, ttsCacheMb)) << 20,
+          clipStoreDir,
+          static_cast<size_t>(std::max(0, clipStoreMb)) << 20,
+          ttsWorkers,
+          ttsBackend,
+          ttsWsUrl,
+          espeakPath,
+          ttsFallbackMs);
+
+  HttpConn chatConn("liveChat");
   auto token = std::string{};
-  std::unordered_set<std::string> ids;
+  // pages only overlap by minutes; 16k ids outlast half an hour of busy chat
+  IdWindow ids(1 << 14, std::chrono::minutes{30});
+  uint64_t seq = 0; // of the last new message
+  ChatBatch batch;  // every poll parses into it and keeps its capacity
+  uint64_t polls = 0;
   bool first = true;
-  for (;;)
-  {
-    try
+  PollScheduler pollScheduler(pollQuotaPerHour);
+  std::function<void()> poll = [&]() {
+    if (!accessToken.valid())
     {
-      auto msgs = chat(apiKey, accessToken, chatId, token);
-      token = msgs.nextPageToken;
-      for (const auto &msg : msgs.msgs)
+      accessToken.refresh(poll);
+      return;
+    }
+    const auto usedToken = accessToken.get();
+    chatReq(chatConn, apiKey, usedToken, chatId, token);
+    loop.add(chatConn, [&, usedToken](CURLcode) {
+      try
+      {
+        const auto allocs = allocCount();
+        chatRes(chatConn, batch);
+        const auto parseAllocs = allocCount() - allocs;
+        if (++polls % 50 == 0)
+          LOG("chat poll messages:", batch.msgs.size(), "allocations to parse:", parseAllocs);
+        token = batch.nextPageToken;
+        auto newMsgs = 0;
+        for (const auto &msg : batch.msgs)
+        {
+          if (!ids.add(msg.id))
+            continue;
+          ++seq;
+          std::cout << msg.name << ": " << msg.msg << std::endl;
+          if (!first)
+          {
+            // the TTS stage keeps copies of what it needs
+            ctx.tts(seq, std::string{msg.name}, std::string{msg.msg}, false);
+            ++newMsgs;
+          }
+        }
+        first = false;
+        loop.after(pollScheduler.next(newMsgs, batch.pollingIntervalMillis), poll);
+        batch.clear();
+      }
+      catch (NeedReauth)
       {
-        if (ids.find(msg.id) != std::end(ids))
-          continue;
-        std::cout << msg.name << ": " << msg.msg << std::endl;
-        if (!first)
-          ctx.tts(msg.name, msg.msg, false);
-        ids.insert(msg.id);
+        accessToken.invalidate(usedToken);
+        accessToken.refresh(poll);
       }
-    }
-    catch (NeedReauth)
-    {
-      accessToken = getAccessToken(clientId, clientSecret, refreshToken);
-    }
-    sleep(6);
-    first = false;
-  }
+      catch (std::exception &e)
+      {
+        LOG(e.what());
+        loop.after(std::chrono::seconds{6}, poll);
+      }
+    });
+  };
+  poll();
+  loop.run();
 
   curl_global_cleanup();
 }
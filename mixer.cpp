@@ -0,0 +1,135 @@
+#include "mixer.hpp"
+#include <algorithm>
+#include <cmath>
+
+Mixer::Channel::Channel(float gain)
+  : ring(RingSz),
+    gain(std::min(MaxGain, std::max(0.f, gain))),
+    gainQ14(static_cast<int16_t>(std::round(this->gain * UnityGainQ14))),
+    loudPrefix(2 * RingSz / IndexBlockSz)
+{
+}
+
+Mixer::Mixer(const std::vector<float> &gains, bool floatBus, int pausePeak) : floatBus(floatBus), pausePeak(pausePeak)
+{
+  for (auto gain : gains)
+    chs.push_back(std::make_unique<Channel>(gain));
+  if (chs.empty())
+    chs.push_back(std::make_unique<Channel>(1.f));
+}
+
+auto Mixer::write(size_t ch, const int16_t *data, size_t sz) -> void
+{
+  auto &c = *chs[ch];
+  if (c.pending.empty())
+  {
+    const auto pushed = publish(c, data, sz);
+    data += pushed;
+    sz -= pushed;
+  }
+  c.pending.insert(std::end(c.pending), data, data + sz);
+}
+
+auto Mixer::pump() -> bool
+{
+  auto ret = false;
+  std::array<int16_t, 4096> tmp;
+  for (auto &c : chs)
+  {
+    while (!c->pending.empty())
+    {
+      const auto sz = std::min(tmp.size(), c->pending.size());
+      std::copy(std::begin(c->pending), std::begin(c->pending) + sz, std::begin(tmp));
+      const auto pushed = publish(*c, tmp.data(), sz);
+      c->pending.erase(std::begin(c->pending), std::begin(c->pending) + pushed);
+      if (pushed < sz)
+        break;
+    }
+    ret = ret || !c->pending.empty();
+  }
+  return ret;
+}
+
+auto Mixer::publish(Channel &c, const int16_t *data, size_t sz) -> size_t
+{
+  // the index has to be in place before the samples become visible
+  sz = std::min(sz, c.ring.freeSpace());
+  index(c, data, sz);
+  return c.ring.push(data, sz);
+}
+
+auto Mixer::index(Channel &c, const int16_t *data, size_t sz) -> void
+{
+  while (sz > 0)
+  {
+    const auto n = std::min(sz, IndexBlockSz - c.indexed % IndexBlockSz);
+    c.blockLoud = c.blockLoud || absPeak(data, n) >= pausePeak;
+    const auto block = c.indexed / IndexBlockSz;
+    c.loudPrefix[block % c.loudPrefix.size()].store(c.loudBefore + (c.blockLoud ? 1 : 0), std::memory_order_relaxed);
+    c.indexed += n;
+    data += n;
+    sz -= n;
+    if (c.indexed % IndexBlockSz != 0)
+      continue;
+    c.loudBefore += c.blockLoud ? 1 : 0;
+    c.blockLoud = false;
+  }
+}
+
+auto Mixer::loudBlocks(const Channel &c, size_t from, size_t to) const -> uint32_t
+{
+  const auto b0 = from / IndexBlockSz;
+  const auto b1 = (to - 1) / IndexBlockSz;
+  const auto &prefix = c.loudPrefix;
+  const auto before = b0 > 0 ? prefix[(b0 - 1) % prefix.size()].load(std::memory_order_relaxed) : 0;
+  return prefix[b1 % prefix.size()].load(std::memory_order_relaxed) - before;
+}
+
+auto Mixer::backlog(size_t ch) const -> size_t
+{
+  return chs[ch]->ring.size() + chs[ch]->pending.size();
+}
+
+auto Mixer::mix(int16_t *out, size_t sz) -> void
+{
+  constexpr size_t BlockSz = 1024;
+  std::array<int16_t, BlockSz> tmp;
+  std::array<float, BlockSz> acc;
+  while (sz > 0)
+  {
+    const auto n = std::min(sz, BlockSz);
+    if (floatBus)
+    {
+      std::fill(std::begin(acc), std::begin(acc) + n, 0.f);
+      for (auto &c : chs)
+        mixF32(acc.data(), tmp.data(), c->ring.pop(tmp.data(), n), c->gain);
+      f32ToS16(out, acc.data(), n);
+    }
+    else
+    {
+      std::fill(out, out + n, 0);
+      for (auto &c : chs)
+        mixS16(out, tmp.data(), c->ring.pop(tmp.data(), n), c->gainQ14);
+    }
+    out += n;
+    sz -= n;
+  }
+}
+
+auto Mixer::paused(size_t sz) const -> bool
+{
+  auto ret = false;
+  for (const auto &c : chs)
+  {
+    const auto queued = c->ring.size();
+    if (queued == 0)
+      continue;
+    if (queued < sz)
+      return false;
+    const auto pos = c->ring.readPos();
+    if (loudBlocks(*c, pos, pos + sz) > 0)
+      return false;
+    ret = true;
+  }
+  return ret;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "dsp.hpp"
+#include "spsc_ring.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Concurrent voice channels mixed on the audio thread. The loop thread writes
+// clips into a channel; up to RingSz samples go into the channel's SPSC ring
+// and the rest waits on the producer side until pump() moves it in.
+//
+// Samples are analyzed once on their way into the ring: every block of
+// IndexBlockSz samples gets a running count of loud blocks, so whether the
+// next N samples are a pause is two lookups on the audio thread.
+class Mixer
+{
+public:
+  // about 11 seconds per channel
+  static constexpr size_t RingSz = 1 << 18;
+  static constexpr size_t IndexBlockSz = 80;
+  // the largest gain the int16 bus holds in Q14; gains are expected in
+  // [0, MaxGain] so both buses play them the same
+  static constexpr float MaxGain = 32767.f / UnityGainQ14;
+
+  // one gain per channel; a float bus sums in float and saturates once, the
+  // int16 bus saturates after every channel; a block with an absolute peak
+  // below pausePeak counts as a pause
+  Mixer(const std::vector<float> &gains, bool floatBus, int pausePeak);
+
+  auto channels() const -> size_t { return chs.size(); }
+
+  // producer side
+  auto write(size_t ch, const int16_t *data, size_t sz) -> void;
+  // returns true while some channel still has samples waiting for ring space
+  auto pump() -> bool;
+  auto backlog(size_t ch) const -> size_t;
+
+  // consumer side
+  auto mix(int16_t *out, size_t sz) -> void;
+  // every channel that is playing has at least sz quiet samples queued
+  auto paused(size_t sz) const -> bool;
+
+private:
+  struct Channel
+  {
+    Channel(float gain);
+    SpscRing<int16_t> ring;
+    std::deque<int16_t> pending;
+    float gain;
+    int16_t gainQ14;
+    // loud blocks so far, including the indexed block, for the last
+    // 2 * RingSz samples; twice the ring so the block before the read
+    // position is still there
+    std::vector<std::atomic<uint32_t>> loudPrefix;
+    size_t indexed = 0;
+    uint32_t loudBefore = 0;
+    bool blockLoud = false;
+  };
+
+  auto publish(Channel &, const int16_t *data, size_t sz) -> size_t;
+  auto index(Channel &, const int16_t *data, size_t sz) -> void;
+  auto loudBlocks(const Channel &, size_t from, size_t to) const -> uint32_t;
+
+  std::vector<std::unique_ptr<Channel>> chs;
+  bool floatBus;
+  int pausePeak;
+};
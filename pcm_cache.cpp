@@ -0,0 +1,61 @@
+#include "pcm_cache.hpp"
+
+PcmCache::PcmCache(size_t budgetBytes) : budgetBytes(budgetBytes) {}
+
+auto PcmCache::key(std::string_view voice, std::string_view ssml) -> uint64_t
+{
+  // FNV-1a, with a separator so ("ab", "c") and ("a", "bc") differ
+  auto ret = uint64_t{14695981039346656037ull};
+  const auto mix = [&ret](std::string_view data) {
+    for (auto ch : data)
+    {
+      ret ^= static_cast<unsigned char>(ch);
+      ret *= 1099511628211ull;
+    }
+  };
+  mix(voice);
+  mix(std::string_view{"\0", 1});
+  mix(ssml);
+  return ret;
+}
+
+auto PcmCache::find(uint64_t key, std::string_view ssml) -> const std::vector<int16_t> *
+{
+  const auto iter = index.find(key);
+  if (iter == std::end(index) || iter->second->ssml != ssml)
+  {
+    ++st.misses;
+    return nullptr;
+  }
+  ++st.hits;
+  lru.splice(std::begin(lru), lru, iter->second);
+  return &iter->second->pcm;
+}
+
+auto PcmCache::insert(uint64_t key, std::string ssml, std::vector<int16_t> pcm) -> void
+{
+  Entry entry{key, std::move(ssml), std::move(pcm)};
+  const auto bytes = entry.bytes();
+  if (bytes > budgetBytes)
+    return;
+  const auto old = index.find(key);
+  if (old != std::end(index))
+  {
+    st.bytes -= old->second->bytes();
+    lru.erase(old->second);
+    index.erase(old);
+  }
+  while (!lru.empty() && st.bytes + bytes > budgetBytes)
+  {
+    const auto &victim = lru.back();
+    ++st.evictions;
+    st.evictedBytes += victim.bytes();
+    st.bytes -= victim.bytes();
+    index.erase(victim.key);
+    lru.pop_back();
+  }
+  lru.push_front(std::move(entry));
+  index[key] = std::begin(lru);
+  st.bytes += bytes;
+  st.entries = lru.size();
+}
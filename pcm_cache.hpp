@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Synthesized clips keyed by a hash of the voice and the final SSML, so a
+// line chat repeats plays from memory instead of going to Azure again.
+// Least recently used clips are evicted to stay within the byte budget.
+class PcmCache
+{
+public:
+  struct Stats
+  {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t evictedBytes = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+  };
+
+  PcmCache(size_t budgetBytes);
+
+  static auto key(std::string_view voice, std::string_view ssml) -> uint64_t;
+
+  // nullptr on a miss; valid until the next insert()
+  auto find(uint64_t key, std::string_view ssml) -> const std::vector<int16_t> *;
+  auto insert(uint64_t key, std::string ssml, std::vector<int16_t> pcm) -> void;
+  auto stats() const -> const Stats & { return st; }
+
+private:
+  struct Entry
+  {
+    uint64_t key;
+    // compared on lookup, a hash collision must not play the wrong clip
+    std::string ssml;
+    std::vector<int16_t> pcm;
+    auto bytes() const -> size_t { return ssml.size() + pcm.size() * sizeof(int16_t); }
+  };
+
+  size_t budgetBytes;
+  std::list<Entry> lru; // most recently used first
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+  Stats st;
+};
@@ -0,0 +1,37 @@
+#include "poll_scheduler.hpp"
+#include <algorithm>
+
+PollScheduler::PollScheduler(double quotaPerHour) : unitsPerSec(quotaPerHour / 3600), units(PollCost) {}
+
+auto PollScheduler::next(int newMsgs, int serverIntervalMs) -> std::chrono::milliseconds
+{
+  const auto now = Clock::now();
+  const auto firstPoll = !hasLastPoll;
+  if (hasLastPoll)
+  {
+    const auto elapsed = std::max(0.001, std::chrono::duration<double>(now - lastPoll).count());
+    // let up to 5 minutes of unused quota pile up for bursts
+    units = std::min(units + elapsed * unitsPerSec, 300 * unitsPerSec + PollCost);
+    const auto Alpha = 0.3;
+    // the first measured rate seeds the average instead of being pulled
+    // towards the 0 it starts at
+    msgsPerSec = hasRate ? Alpha * newMsgs / elapsed + (1 - Alpha) * msgsPerSec : newMsgs / elapsed;
+    hasRate = true;
+  }
+  lastPoll = now;
+  hasLastPoll = true;
+  units -= PollCost;
+
+  // in double until clamped, the EWMA decays towards 0 in a quiet chat and
+  // the quotient overflows int long before it gets there
+  auto ms = msgsPerSec > 0 ? std::min<double>(MaxIntervalMs, 1000 * TargetMsgsPerPoll / msgsPerSec) : MaxIntervalMs;
+  // the startup page holds the backlog, not new messages, so there is no
+  // rate yet; poll again at the server's pace rather than wait out the
+  // quiet-chat cap in what may be a busy chat
+  if (firstPoll)
+    ms = serverIntervalMs > 0 ? serverIntervalMs : FirstIntervalMs;
+  ms = std::max<double>(ms, serverIntervalMs);
+  if (units < 0 && unitsPerSec > 0)
+    ms = std::max(ms, std::min<double>(MaxQuotaWaitMs, 1000 * -units / unitsPerSec));
+  return std::chrono::milliseconds{static_cast<int>(ms)};
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <chrono>
+
+// Picks the delay before the next liveChat/messages poll. The server's
+// pollingIntervalMillis is the floor, busy chats are polled at that floor,
+// quiet ones back off, and a token bucket keeps the average spend within
+// the configured YouTube API quota.
+class PollScheduler
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  PollScheduler(double quotaPerHour);
+
+  // call once per completed poll
+  auto next(int newMsgs, int serverIntervalMs) -> std::chrono::milliseconds;
+
+private:
+  static constexpr double PollCost = 5;
+  static constexpr double TargetMsgsPerPoll = 3;
+  static constexpr int MaxIntervalMs = 20000;
+  static constexpr int FirstIntervalMs = 6000; // without pollingIntervalMillis
+  static constexpr int MaxQuotaWaitMs = 3600 * 1000;
+
+  double unitsPerSec;
+  double units;
+  double msgsPerSec = 0;
+  Clock::time_point lastPoll;
+  bool hasLastPoll = false;
+  bool hasRate = false;
+};
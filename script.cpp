@@ -0,0 +1,124 @@
+#include "script.hpp"
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCRIPT_X86 1
+#include <immintrin.h>
+#endif
+
+static auto isAsciiLetter(unsigned char ch) -> bool
+{
+  return static_cast<unsigned char>((ch | 0x20) - 'a') < 26;
+}
+
+static auto classify(char32_t cp, Scripts &ret) -> void
+{
+  if ((cp >= 0x00c0 && cp <= 0x024f && cp != 0x00d7 && cp != 0x00f7) || (cp >= 0x1e00 && cp <= 0x1eff))
+    ret.latin = true;
+  else if (cp >= 0x0400 && cp <= 0x04ff)
+    ret.cyrillic = true;
+  else if ((cp >= 0x3040 && cp <= 0x30ff) || (cp >= 0x31f0 && cp <= 0x31ff) || (cp >= 0xff66 && cp <= 0xff9f))
+    ret.kana = true;
+  else if ((cp >= 0xac00 && cp <= 0xd7af) || (cp >= 0x1100 && cp <= 0x11ff) || (cp >= 0x3130 && cp <= 0x318f))
+    ret.hangul = true;
+  else if ((cp >= 0x4e00 && cp <= 0x9fff) || (cp >= 0x3400 && cp <= 0x4dbf) || (cp >= 0xf900 && cp <= 0xfaff) ||
+           (cp >= 0x20000 && cp <= 0x3134f))
+    ret.han = true;
+}
+
+// length of the sequence at data[0], 0 if it is malformed or cut short
+static auto decode(const unsigned char *data, size_t sz, char32_t &cp) -> size_t
+{
+  const auto lead = data[0];
+  size_t len;
+  if (lead >= 0xc2 && lead <= 0xdf)
+  {
+    len = 2;
+    cp = lead & 0x1f;
+  }
+  else if (lead >= 0xe0 && lead <= 0xef)
+  {
+    len = 3;
+    cp = lead & 0x0f;
+  }
+  else if (lead >= 0xf0 && lead <= 0xf4)
+  {
+    len = 4;
+    cp = lead & 0x07;
+  }
+  else
+    return 0;
+  if (len > sz)
+    return 0;
+  for (auto i = 1u; i < len; ++i)
+  {
+    if ((data[i] & 0xc0) != 0x80)
+      return 0;
+    cp = (cp << 6) | (data[i] & 0x3f);
+  }
+  return len;
+}
+
+#ifdef SCRIPT_X86
+// number of leading bytes that are ASCII, a multiple of 16
+__attribute__((target("sse2"))) static auto asciiRunSse2(const unsigned char *data, size_t sz, Scripts &ret) -> size_t
+{
+  const auto caseBit = _mm_set1_epi8(0x20);
+  const auto beforeA = _mm_set1_epi8('a' - 1);
+  const auto afterZ = _mm_set1_epi8('z' + 1);
+  auto i = size_t{};
+  for (; i + 16 <= sz; i += 16)
+  {
+    const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    if (_mm_movemask_epi8(v) != 0)
+      break;
+    if (ret.latin)
+      continue;
+    // all bytes are below 0x80 here, so the signed compares are safe
+    const auto lower = _mm_or_si128(v, caseBit);
+    const auto letters = _mm_and_si128(_mm_cmpgt_epi8(lower, beforeA), _mm_cmplt_epi8(lower, afterZ));
+    ret.latin = _mm_movemask_epi8(letters) != 0;
+  }
+  return i;
+}
+
+static auto hasSse2() -> bool
+{
+  static const bool ret = __builtin_cpu_supports("sse2");
+  return ret;
+}
+#endif
+
+auto detectScripts(std::string_view text) -> Scripts
+{
+  Scripts ret;
+  const auto data = reinterpret_cast<const unsigned char *>(text.data());
+  const auto sz = text.size();
+  for (size_t i = 0; i < sz;)
+  {
+#ifdef SCRIPT_X86
+    if (hasSse2())
+    {
+      i += asciiRunSse2(data + i, sz - i, ret);
+      if (i == sz)
+        break;
+    }
+#endif
+    if (data[i] < 0x80)
+    {
+      ret.latin = ret.latin || isAsciiLetter(data[i]);
+      ++i;
+      continue;
+    }
+    char32_t cp;
+    const auto len = decode(data + i, sz - i, cp);
+    if (len == 0)
+    {
+      ++i;
+      continue;
+    }
+    classify(cp, ret);
+    i += len;
+  }
+  return ret;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <string_view>
+
+// Writing systems that have at least one letter in a message.
+struct Scripts
+{
+  bool latin = false;
+  bool cyrillic = false;
+  bool han = false;
+  bool kana = false;
+  bool hangul = false;
+};
+
+// One pass over UTF-8 bytes without decoding to UTF-16 or allocating; runs
+// of ASCII are skipped 16 bytes at a time. Malformed sequences are ignored.
+auto detectScripts(std::string_view text) -> Scripts;
@@ -0,0 +1,92 @@
+#include "sentences.hpp"
+
+enum class Break { None, Clause, Sentence };
+
+// Whether the punctuation at pos ends a sentence or a clause; end is past
+// the punctuation and next past the spaces after it. ASCII punctuation
+// only counts with a space after it, so "3.14", "a,b" and the first
+// character of "?!" or "..." are not breaks.
+static auto breakAt(std::string_view text, size_t pos, size_t &end, size_t &next) -> Break
+{
+  auto ret = Break::None;
+  switch (text[pos])
+  {
+  case '.':
+  case '!':
+  case '?': ret = Break::Sentence; break;
+  case ',':
+  case ':': ret = Break::Clause; break;
+  }
+  if (ret != Break::None)
+  {
+    if (pos + 1 >= text.size() || text[pos + 1] != ' ')
+      return Break::None;
+    end = pos + 1;
+  }
+  else
+  {
+    // 。！？ and 、，
+    const auto cjk = text.substr(pos, 3);
+    if (cjk == "\xe3\x80\x82" || cjk == "\xef\xbc\x81" || cjk == "\xef\xbc\x9f")
+      ret = Break::Sentence;
+    else if (cjk == "\xe3\x80\x81" || cjk == "\xef\xbc\x8c")
+      ret = Break::Clause;
+    else
+      return Break::None;
+    end = pos + 3;
+  }
+  next = end;
+  while (next < text.size() && text[next] == ' ')
+    ++next;
+  return ret;
+}
+
+static auto trimRight(std::string_view text) -> std::string_view
+{
+  while (!text.empty() && text.back() == ' ')
+    text.remove_suffix(1);
+  return text;
+}
+
+auto splitSentences(std::string_view text, size_t minLen, size_t maxLen) -> std::vector<std::string_view>
+{
+  std::vector<std::string_view> ret;
+  size_t start = 0;
+  // the last clause break of the piece, a cut there leaves at least minLen
+  size_t clauseEnd = 0;
+  size_t clauseNext = 0;
+  const auto cut = [&](size_t end, size_t next) {
+    ret.push_back(text.substr(start, end - start));
+    start = next;
+    clauseNext = 0;
+  };
+  for (size_t pos = 0; pos < text.size(); ++pos)
+  {
+    if (pos - start > maxLen && clauseNext > start)
+      cut(clauseEnd, clauseNext);
+    size_t end;
+    size_t next;
+    const auto kind = breakAt(text, pos, end, next);
+    if (kind == Break::None || end - start < minLen)
+      continue;
+    if (kind == Break::Sentence)
+      cut(end, next);
+    else
+    {
+      clauseEnd = end;
+      clauseNext = next;
+    }
+    pos = next - 1;
+  }
+  const auto rest = trimRight(text.substr(start));
+  if (rest.empty())
+    return ret;
+  if (!ret.empty() && rest.size() < minLen)
+  {
+    const auto from = static_cast<size_t>(ret.back().data() - text.data());
+    ret.back() = trimRight(text.substr(from));
+    return ret;
+  }
+  ret.push_back(rest);
+  return ret;
+}
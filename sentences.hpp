@@ -0,0 +1,10 @@
+#pragma once
+#include <string_view>
+#include <vector>
+
+// Cuts text into pieces that are synthesized on their own: at sentence ends
+// once a piece has minLen bytes, and at clause breaks (commas, colons) when
+// a sentence runs past maxLen. A short rest joins the piece before it.
+// Pieces are views into text and together cover all of it but the spaces
+// at the cuts. Understands ASCII and CJK punctuation.
+auto splitSentences(std::string_view text, size_t minLen, size_t maxLen) -> std::vector<std::string_view>;
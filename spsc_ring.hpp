@@ -0,0 +1,82 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Fixed-capacity single-producer/single-consumer ring. Neither side ever
+// blocks or allocates, so the consumer can live on the real-time audio
+// thread. Capacity is rounded up to a power of two.
+template <typename T>
+class SpscRing
+{
+public:
+  struct Span
+  {
+    const T *data;
+    size_t size;
+  };
+
+  explicit SpscRing(size_t minCapacity) : buf(roundUp(minCapacity)), mask(buf.size() - 1) {}
+
+  auto capacity() const -> size_t { return buf.size(); }
+
+  // producer side, push() takes at least this many
+  auto freeSpace() const -> size_t { return buf.size() - (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire)); }
+
+  // producer side, returns how many elements fit
+  auto push(const T *data, size_t sz) -> size_t
+  {
+    const auto h = head.load(std::memory_order_relaxed);
+    const auto t = tail.load(std::memory_order_acquire);
+    sz = std::min(sz, buf.size() - (h - t));
+    const auto first = std::min(sz, buf.size() - (h & mask));
+    std::copy(data, data + first, buf.data() + (h & mask));
+    std::copy(data + first, data + sz, buf.data());
+    head.store(h + sz, std::memory_order_release);
+    return sz;
+  }
+
+  // consumer side, wait-free
+  auto pop(T *data, size_t sz) -> size_t
+  {
+    const auto spans = peek(sz);
+    std::copy(spans[0].data, spans[0].data + spans[0].size, data);
+    std::copy(spans[1].data, spans[1].data + spans[1].size, data + spans[0].size);
+    sz = spans[0].size + spans[1].size;
+    tail.store(tail.load(std::memory_order_relaxed) + sz, std::memory_order_release);
+    return sz;
+  }
+
+  // consumer side, up to sz readable elements as at most two contiguous pieces
+  auto peek(size_t sz) const -> std::array<Span, 2>
+  {
+    const auto t = tail.load(std::memory_order_relaxed);
+    const auto h = head.load(std::memory_order_acquire);
+    sz = std::min(sz, h - t);
+    const auto first = std::min(sz, buf.size() - (t & mask));
+    return {Span{buf.data() + (t & mask), first}, Span{buf.data(), sz - first}};
+  }
+
+  // consumer side, elements consumed so far
+  auto readPos() const -> size_t { return tail.load(std::memory_order_relaxed); }
+
+  // the other side may move concurrently: a lower bound for the consumer, an
+  // upper bound for the producer
+  auto size() const -> size_t { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+private:
+  static auto roundUp(size_t value) -> size_t
+  {
+    size_t ret = 1;
+    while (ret < value)
+      ret <<= 1;
+    return ret;
+  }
+
+  std::vector<T> buf;
+  size_t mask;
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+};
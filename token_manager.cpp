@@ -0,0 +1,82 @@
+#include "token_manager.hpp"
+#include "log/log.hpp"
+#include <algorithm>
+
+TokenManager::TokenManager(EventLoop &loop, std::string name, Req req, Res res)
+  : loop(loop), conn(std::move(name)), req(std::move(req)), res(std::move(res))
+{
+}
+
+auto TokenManager::fetchNow() -> void
+{
+  req(conn);
+  if (conn.perform() != CURLE_OK)
+    throw std::runtime_error("token request failed");
+  apply(res(conn));
+}
+
+auto TokenManager::valid() const -> bool
+{
+  return !token.empty() && EventLoop::Clock::now() < expiresAt;
+}
+
+auto TokenManager::refresh(std::function<void()> then) -> void
+{
+  if (then)
+    waiters.push_back(std::move(then));
+  if (pending)
+    return;
+  pending = true;
+  req(conn);
+  loop.add(conn, [this](CURLcode code) {
+    pending = false;
+    try
+    {
+      if (code != CURLE_OK)
+        throw std::runtime_error("token transfer failed");
+      apply(res(conn));
+    }
+    catch (std::exception &e)
+    {
+      LOG(e.what());
+      retryLater();
+      return;
+    }
+    auto tmp = std::move(waiters);
+    waiters.clear();
+    for (auto &waiter : tmp)
+      waiter();
+  });
+}
+
+auto TokenManager::invalidate(const std::string &stale) -> void
+{
+  if (stale == token)
+    token.clear();
+}
+
+auto TokenManager::apply(Token value) -> void
+{
+  if (value.value.empty())
+    throw std::runtime_error("empty token");
+  token = std::move(value.value);
+  const auto now = EventLoop::Clock::now();
+  expiresAt = now + value.expiresIn;
+  // refresh with a tenth of the lifetime, but at least 30 seconds, to spare
+  const auto margin = std::max<std::chrono::seconds>(std::chrono::seconds{30}, value.expiresIn / 10);
+  const auto delay = std::max<std::chrono::seconds>(std::chrono::seconds{1}, value.expiresIn - margin);
+  const auto gen = ++generation;
+  loop.after(delay, [this, gen]() {
+    if (gen == generation)
+      refresh();
+  });
+}
+
+auto TokenManager::retryLater() -> void
+{
+  const auto gen = ++generation;
+  loop.after(std::chrono::seconds{5}, [this, gen]() {
+    if (gen == generation)
+      refresh();
+  });
+}
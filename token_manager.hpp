@@ -0,0 +1,48 @@
+#pragma once
+#include "event_loop.hpp"
+#include "http_conn.hpp"
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct Token
+{
+  std::string value;
+  std::chrono::seconds expiresIn;
+};
+
+// Keeps one bearer token fresh. The expiry is recorded when the token is
+// fetched, and a refresh runs on the loop well before the token expires, so
+// requests on the hot path always carry a token that is still valid.
+class TokenManager
+{
+public:
+  using Req = std::function<void(HttpConn &)>;
+  using Res = std::function<Token(const HttpConn &)>;
+
+  TokenManager(EventLoop &, std::string name, Req, Res);
+
+  // blocking fetch for startup, before the loop runs
+  auto fetchNow() -> void;
+  auto get() const -> const std::string & { return token; }
+  auto valid() const -> bool;
+  // starts a refresh unless one is in flight, then calls back once a token is available
+  auto refresh(std::function<void()> then = nullptr) -> void;
+  // the server rejected this token, drop it unless it was already replaced
+  auto invalidate(const std::string &stale) -> void;
+
+private:
+  auto apply(Token) -> void;
+  auto retryLater() -> void;
+
+  EventLoop &loop;
+  HttpConn conn;
+  Req req;
+  Res res;
+  std::string token;
+  EventLoop::Clock::time_point expiresAt;
+  bool pending = false;
+  int generation = 0;
+  std::vector<std::function<void()>> waiters;
+};
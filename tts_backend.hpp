@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// A speech engine as the TTS pipeline sees it: SSML in, raw 24 kHz 16-bit
+// mono PCM out while it is being synthesized. Backends take care of their
+// own connections and credentials and run any number of syntheses at once.
+class TtsBackend
+{
+public:
+  // PCM bytes as they are produced, not necessarily whole samples
+  using OnAudio = std::function<void(const char *, size_t)>;
+  // 200 when done, the HTTP status if the service turned the request down,
+  // 0 if it could not be reached, broke off or timed out
+  using OnDone = std::function<void(long status)>;
+
+  virtual ~TtsBackend() = default;
+
+  // returns an id for cancel(); the callbacks run on the loop thread, never
+  // from inside synthesize()
+  virtual auto synthesize(const std::string &voice, const std::string &ssml, OnAudio, OnDone) -> uint64_t = 0;
+  // stops a synthesis without calling its callbacks again
+  virtual auto cancel(uint64_t id) -> void = 0;
+};
@@ -0,0 +1,111 @@
+#include "voices.hpp"
+#include "log/log.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+VoiceMap::VoiceMap(EventLoop &loop, std::string path) : loop(loop), path(std::move(path))
+{
+  const auto slash = this->path.rfind('/');
+  const auto dir = slash == std::string::npos ? std::string{"."} : this->path.substr(0, slash + 1);
+  fileName = slash == std::string::npos ? this->path : this->path.substr(slash + 1);
+
+  load();
+
+  // kill -HUP forces a reload, main() keeps SIGHUP blocked so it lands here
+  sigset_t hup;
+  sigemptyset(&hup);
+  sigaddset(&hup, SIGHUP);
+  hupFd = signalfd(-1, &hup, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (hupFd < 0)
+    LOG("signalfd error:", strerror(errno));
+  else
+    loop.watch(hupFd, [this]() { onHup(); });
+
+  // watch the directory, editors usually save by renaming over the file
+  fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0 || inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+  {
+    LOG("inotify error:", strerror(errno), "-", this->path, "will not be reloaded");
+    if (fd >= 0)
+      close(fd);
+    fd = -1;
+    return;
+  }
+  loop.watch(fd, [this]() { onEvents(); });
+}
+
+VoiceMap::~VoiceMap()
+{
+  for (auto f : {fd, hupFd})
+  {
+    if (f < 0)
+      continue;
+    loop.unwatch(f);
+    close(f);
+  }
+}
+
+auto VoiceMap::load() -> void
+{
+  auto snapshot = std::make_unique<Snapshot>();
+  snapshot->version = owned ? owned->version + 1 : 0;
+  std::ifstream f(path);
+  if (!f)
+    LOG("File", path, "is missing");
+  std::string line;
+  while (std::getline(f, line))
+  {
+    std::istringstream strm(line);
+    std::string name;
+    std::getline(strm, name, '=');
+    std::string voice;
+    std::getline(strm, voice);
+    snapshot->voices[name] = voice;
+  }
+
+  current.store(snapshot.get(), std::memory_order_release);
+  if (!owned)
+  {
+    owned = std::move(snapshot);
+    return;
+  }
+  retired.push_back(std::move(owned));
+  owned = std::move(snapshot);
+  loop.after(RetireAfter, [this]() { retired.pop_front(); });
+}
+
+auto VoiceMap::onEvents() -> void
+{
+  auto changed = false;
+  alignas(inotify_event) char buf[4096];
+  for (;;)
+  {
+    const auto sz = read(fd, buf, sizeof(buf));
+    if (sz <= 0)
+      break;
+    for (auto p = buf; p < buf + sz;)
+    {
+      const auto event = reinterpret_cast<const inotify_event *>(p);
+      changed = changed || (event->len > 0 && fileName == event->name);
+      p += sizeof(inotify_event) + event->len;
+    }
+  }
+  if (!changed)
+    return;
+  LOG("Reloading", path);
+  load();
+}
+
+auto VoiceMap::onHup() -> void
+{
+  signalfd_siginfo info;
+  while (read(hupFd, &info, sizeof(info)) == sizeof(info)) {}
+  LOG("SIGHUP, reloading", path);
+  load();
+}
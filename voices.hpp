@@ -0,0 +1,50 @@
+#pragma once
+#include "event_loop.hpp"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// voices.txt, "name=voice" per line, as an immutable snapshot. The loop
+// thread rebuilds it when inotify reports the file was written or replaced,
+// or on SIGHUP, and publishes it with one pointer swap, so readers on any
+// thread get a consistent map from a single atomic load.
+class VoiceMap
+{
+public:
+  using Voices = std::unordered_map<std::string, std::string>;
+  struct Snapshot
+  {
+    Voices voices;
+    // bumps with every reload, so caches built from an older map can tell
+    uint64_t version;
+  };
+
+  // a replaced snapshot stays alive this long, readers must not hold one
+  // across more than a single request
+  static constexpr auto RetireAfter = std::chrono::seconds{60};
+
+  VoiceMap(EventLoop &, std::string path);
+  VoiceMap(const VoiceMap &) = delete;
+  VoiceMap &operator=(const VoiceMap &) = delete;
+  ~VoiceMap();
+
+  // wait-free
+  auto get() const -> const Snapshot & { return *current.load(std::memory_order_acquire); }
+
+private:
+  auto load() -> void;
+  auto onEvents() -> void;
+  auto onHup() -> void;
+
+  EventLoop &loop;
+  std::string path;
+  std::string fileName;
+  int fd = -1;
+  int hupFd = -1;
+  std::atomic<const Snapshot *> current;
+  std::unique_ptr<const Snapshot> owned;
+  std::deque<std::unique_ptr<const Snapshot>> retired;
+};
@@ -0,0 +1,384 @@
+#include "ws_conn.hpp"
+#include "log/log.hpp"
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <random>
+
+static auto base64(const unsigned char *data, size_t sz) -> std::string
+{
+  static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string ret;
+  for (size_t i = 0; i < sz; i += 3)
+  {
+    const auto n = (data[i] << 16) | ((i + 1 < sz ? data[i + 1] : 0) << 8) | (i + 2 < sz ? data[i + 2] : 0);
+    ret += chars[(n >> 18) & 63];
+    ret += chars[(n >> 12) & 63];
+    ret += i + 1 < sz ? chars[(n >> 6) & 63] : '=';
+    ret += i + 2 < sz ? chars[n & 63] : '=';
+  }
+  return ret;
+}
+
+// only for the upgrade handshake, which RFC 6455 builds on SHA-1
+static auto sha1(std::string_view data) -> std::array<unsigned char, 20>
+{
+  const auto rol = [](uint32_t x, int n) { return (x << n) | (x >> (32 - n)); };
+  uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+  std::string msg{data};
+  msg += '\x80';
+  while (msg.size() % 64 != 56)
+    msg += '\0';
+  for (auto shift = 56; shift >= 0; shift -= 8)
+    msg += static_cast<char>(static_cast<uint64_t>(data.size()) * 8 >> shift);
+  for (size_t block = 0; block < msg.size(); block += 64)
+  {
+    uint32_t w[80];
+    for (auto i = 0; i < 16; ++i)
+    {
+      w[i] = 0;
+      for (auto j = 0; j < 4; ++j)
+        w[i] = (w[i] << 8) | static_cast<unsigned char>(msg[block + 4 * i + j]);
+    }
+    for (auto i = 16; i < 80; ++i)
+      w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    auto a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (auto i = 0; i < 80; ++i)
+    {
+      static const uint32_t k[] = {0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6};
+      const auto f = i < 20 ? (b & c) | (~b & d) : i >= 40 && i < 60 ? (b & c) | (b & d) | (c & d) : b ^ c ^ d;
+      const auto t = rol(a, 5) + f + e + k[i / 20] + w[i];
+      e = d;
+      d = c;
+      c = rol(b, 30);
+      b = a;
+      a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+  std::array<unsigned char, 20> ret;
+  for (auto i = 0; i < 20; ++i)
+    ret[i] = static_cast<unsigned char>(h[i / 4] >> (24 - 8 * (i % 4)));
+  return ret;
+}
+
+static auto rng() -> std::mt19937 &
+{
+  static std::mt19937 ret{std::random_device{}()};
+  return ret;
+}
+
+WsConn::WsConn(EventLoop &loop, std::string name) : loop(loop), name(std::move(name)) {}
+
+WsConn::~WsConn()
+{
+  close();
+}
+
+auto WsConn::open(const std::string &url,
+                  const std::vector<std::string> &headers,
+                  std::function<void()> ready,
+                  OnMessage onMessage,
+                  OnClose onClose) -> void
+{
+  close();
+  this->ready = std::move(ready);
+  this->onMessage = std::move(onMessage);
+  this->onClose = std::move(onClose);
+  state = State::Connecting;
+  conn = std::make_unique<HttpConn>(name);
+  auto curl = conn->reset(url);
+  // the transfer completes once TCP and TLS are up, the socket stays ours
+  curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 1L);
+  loop.connect(*conn, [this, url, headers](CURLcode res) {
+    if (res != CURLE_OK)
+    {
+      fail(0);
+      return;
+    }
+    connected(url, headers);
+  });
+}
+
+auto WsConn::connected(const std::string &url, const std::vector<std::string> &headers) -> void
+{
+  curl_socket_t sock = CURL_SOCKET_BAD;
+  curl_easy_getinfo(conn->handle(), CURLINFO_ACTIVESOCKET, &sock);
+  if (sock == CURL_SOCKET_BAD)
+  {
+    fail(0);
+    return;
+  }
+  fd = sock;
+  loop.watch(fd, [this]() { onReadable(); });
+
+  std::unique_ptr<CURLU, decltype(&curl_url_cleanup)> parsed(curl_url(), &curl_url_cleanup);
+  curl_url_set(parsed.get(), CURLUPART_URL, url.c_str(), 0);
+  const auto part = [&parsed](CURLUPart what) {
+    char *value = nullptr;
+    if (curl_url_get(parsed.get(), what, &value, 0) != CURLUE_OK)
+      return std::string{};
+    std::string ret = value;
+    curl_free(value);
+    return ret;
+  };
+  const auto port = part(CURLUPART_PORT);
+  const auto query = part(CURLUPART_QUERY);
+
+  unsigned char nonce[16];
+  for (auto &byte : nonce)
+    byte = static_cast<unsigned char>(rng()());
+  const auto key = base64(nonce, sizeof(nonce));
+  // what the server has to answer with, RFC 6455 section 4.2.2
+  const auto digest = sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+  accept = base64(digest.data(), digest.size());
+  auto req = "GET " + part(CURLUPART_PATH) + (query.empty() ? "" : "?" + query) + " HTTP/1.1\r\n" +
+             "Host: " + part(CURLUPART_HOST) + (port.empty() ? "" : ":" + port) + "\r\n" +
+             "Upgrade: websocket\r\n"
+             "Connection: Upgrade\r\n"
+             "Sec-WebSocket-Key: " +
+             key + "\r\n" + "Sec-WebSocket-Version: 13\r\n";
+  for (const auto &header : headers)
+    req += header + "\r\n";
+  req += "\r\n";
+  state = State::Upgrading;
+  outBuf += req;
+  flush();
+}
+
+auto WsConn::sendText(std::string_view data) -> void
+{
+  sendFrame(0x1, data);
+}
+
+auto WsConn::sendBinary(std::string_view data) -> void
+{
+  sendFrame(0x2, data);
+}
+
+auto WsConn::sendFrame(int opcode, std::string_view data) -> void
+{
+  if (state != State::Open)
+    return;
+  // client frames are always masked
+  unsigned char mask[4];
+  for (auto &byte : mask)
+    byte = static_cast<unsigned char>(rng()());
+  outBuf += static_cast<char>(0x80 | opcode);
+  const auto sz = data.size();
+  if (sz < 126)
+    outBuf += static_cast<char>(0x80 | sz);
+  else if (sz <= 0xffff)
+  {
+    outBuf += static_cast<char>(0x80 | 126);
+    outBuf += static_cast<char>(sz >> 8);
+    outBuf += static_cast<char>(sz);
+  }
+  else
+  {
+    outBuf += static_cast<char>(0x80 | 127);
+    for (auto shift = 56; shift >= 0; shift -= 8)
+      outBuf += static_cast<char>(static_cast<uint64_t>(sz) >> shift);
+  }
+  outBuf.append(reinterpret_cast<const char *>(mask), sizeof(mask));
+  const auto pos = outBuf.size();
+  outBuf += data;
+  for (auto i = size_t{}; i < sz; ++i)
+    outBuf[pos + i] ^= static_cast<char>(mask[i % 4]);
+  flush();
+}
+
+auto WsConn::flush() -> void
+{
+  while (!outBuf.empty() && fd >= 0)
+  {
+    size_t sent = 0;
+    const auto res = curl_easy_send(conn->handle(), outBuf.data(), outBuf.size(), &sent);
+    if (res == CURLE_AGAIN)
+      break;
+    if (res != CURLE_OK)
+    {
+      LOG("websocket send error:", curl_easy_strerror(res));
+      fail(0);
+      return;
+    }
+    outBuf.erase(0, sent);
+  }
+  // the socket buffer is full, which hardly happens with SSML-sized
+  // messages; try again shortly rather than watching for writability
+  if (outBuf.empty() || flushScheduled || fd < 0)
+    return;
+  flushScheduled = true;
+  loop.after(std::chrono::milliseconds{5}, [this]() {
+    flushScheduled = false;
+    flush();
+  });
+}
+
+auto WsConn::onReadable() -> void
+{
+  char buf[16384];
+  auto eof = false;
+  for (;;)
+  {
+    size_t received = 0;
+    const auto res = curl_easy_recv(conn->handle(), buf, sizeof(buf), &received);
+    if (res == CURLE_AGAIN)
+      break;
+    if (res != CURLE_OK || received == 0)
+    {
+      if (res != CURLE_OK)
+        LOG("websocket recv error:", curl_easy_strerror(res));
+      eof = true;
+      break;
+    }
+    inBuf.append(buf, received);
+  }
+  // whatever arrived before the peer closed is still delivered
+  if (state == State::Upgrading && !parseUpgrade() && !eof)
+    return;
+  if (state == State::Open)
+    parseFrames();
+  if (eof && !isClosed())
+    fail(0);
+}
+
+auto WsConn::parseUpgrade() -> bool
+{
+  const auto end = inBuf.find("\r\n\r\n");
+  if (end == std::string::npos)
+    return false;
+  // "HTTP/1.1 101 Switching Protocols"
+  const auto status = inBuf.size() > 12 ? std::atol(inBuf.c_str() + 9) : 0;
+  if (status != 101)
+  {
+    LOG("websocket upgrade failed:", inBuf.substr(0, inBuf.find("\r\n")));
+    fail(status);
+    return false;
+  }
+  // a proxy or server that does not speak WebSocket would not know it
+  auto accepted = false;
+  for (auto pos = inBuf.find("\r\n"); pos < end && !accepted; pos = inBuf.find("\r\n", pos + 2))
+  {
+    const auto line = std::string_view{inBuf}.substr(pos + 2, inBuf.find("\r\n", pos + 2) - pos - 2);
+    const auto colon = line.find(':');
+    if (colon == std::string_view::npos)
+      continue;
+    auto name = std::string{line.substr(0, colon)};
+    for (auto &ch : name)
+      ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    auto value = line.substr(colon + 1);
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+      value.remove_prefix(1);
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+      value.remove_suffix(1);
+    accepted = name == "sec-websocket-accept" && value == accept;
+  }
+  if (!accepted)
+  {
+    LOG("websocket upgrade failed: no or wrong Sec-WebSocket-Accept");
+    fail(0);
+    return false;
+  }
+  inBuf.erase(0, end + 4);
+  state = State::Open;
+  if (ready)
+    ready();
+  return state == State::Open;
+}
+
+auto WsConn::parseFrames() -> bool
+{
+  size_t pos = 0;
+  while (state == State::Open)
+  {
+    if (inBuf.size() - pos < 2)
+      break;
+    const auto b0 = static_cast<unsigned char>(inBuf[pos]);
+    const auto b1 = static_cast<unsigned char>(inBuf[pos + 1]);
+    const auto fin = (b0 & 0x80) != 0;
+    const auto opcode = b0 & 0x0f;
+    const auto masked = (b1 & 0x80) != 0;
+    auto header = size_t{2};
+    uint64_t sz = b1 & 0x7f;
+    if (sz >= 126)
+    {
+      const auto extra = sz == 126 ? 2u : 8u;
+      if (inBuf.size() - pos < header + extra)
+        break;
+      sz = 0;
+      for (auto i = 0u; i < extra; ++i)
+        sz = (sz << 8) | static_cast<unsigned char>(inBuf[pos + header + i]);
+      header += extra;
+    }
+    const auto maskPos = pos + header;
+    if (masked)
+      header += 4;
+    if (inBuf.size() - pos < header + sz)
+      break;
+    auto payload = inBuf.substr(pos + header, sz);
+    if (masked)
+      for (auto i = size_t{}; i < payload.size(); ++i)
+        payload[i] ^= inBuf[maskPos + i % 4];
+    pos += header + sz;
+
+    switch (opcode)
+    {
+    case 0x0: // continuation
+      message += payload;
+      break;
+    case 0x1:
+    case 0x2:
+      message = std::move(payload);
+      messageBinary = opcode == 0x2;
+      break;
+    case 0x8:
+      // answer with the status code it came with before dropping the socket
+      LOG("websocket closed by peer");
+      sendFrame(0x8, payload.substr(0, 2));
+      fail(0);
+      return false;
+    case 0x9: sendFrame(0xa, payload); continue;
+    default: continue;
+    }
+    if (!fin)
+      continue;
+    auto done = std::move(message);
+    message.clear();
+    if (onMessage)
+      onMessage(messageBinary, done);
+  }
+  if (state == State::Open)
+    inBuf.erase(0, pos);
+  return state == State::Open;
+}
+
+auto WsConn::fail(long status) -> void
+{
+  auto cb = std::move(onClose);
+  close();
+  if (cb)
+    cb(status);
+}
+
+auto WsConn::close() -> void
+{
+  if (fd >= 0)
+    loop.unwatch(fd);
+  fd = -1;
+  state = State::Closed;
+  ready = nullptr;
+  onMessage = nullptr;
+  onClose = nullptr;
+  outBuf.clear();
+  inBuf.clear();
+  message.clear();
+  if (!conn)
+    return;
+  loop.cancel(*conn);
+  conn.reset();
+}
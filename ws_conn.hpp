@@ -0,0 +1,62 @@
+#pragma once
+#include "event_loop.hpp"
+#include "http_conn.hpp"
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Client WebSocket on top of a CONNECT_ONLY curl handle. curl resolves,
+// connects and does TLS through the shared caches like every HttpConn; the
+// upgrade request and the framing (RFC 6455) are done here. Frames are read
+// on the loop thread whenever the socket is readable.
+class WsConn
+{
+public:
+  using OnMessage = std::function<void(bool binary, std::string_view)>;
+  // status is the HTTP code of a failed upgrade, 0 for anything else
+  using OnClose = std::function<void(long status)>;
+
+  WsConn(EventLoop &, std::string name);
+  WsConn(const WsConn &) = delete;
+  WsConn &operator=(const WsConn &) = delete;
+  ~WsConn();
+
+  // url is http:// or https://; ready runs once the upgrade went through
+  auto open(const std::string &url, const std::vector<std::string> &headers, std::function<void()> ready, OnMessage, OnClose)
+    -> void;
+  auto isOpen() const -> bool { return state == State::Open; }
+  auto isClosed() const -> bool { return state == State::Closed; }
+  auto sendText(std::string_view) -> void;
+  auto sendBinary(std::string_view) -> void;
+  // drops the connection without calling OnClose
+  auto close() -> void;
+
+private:
+  enum class State { Closed, Connecting, Upgrading, Open };
+
+  auto connected(const std::string &url, const std::vector<std::string> &headers) -> void;
+  auto sendFrame(int opcode, std::string_view) -> void;
+  auto flush() -> void;
+  auto onReadable() -> void;
+  auto parseUpgrade() -> bool;
+  auto parseFrames() -> bool;
+  auto fail(long status) -> void;
+
+  EventLoop &loop;
+  std::string name;
+  // one handle per connection, destroying it closes the socket
+  std::unique_ptr<HttpConn> conn;
+  State state = State::Closed;
+  int fd = -1;
+  std::string accept; // the Sec-WebSocket-Accept the upgrade has to come with
+  std::function<void()> ready;
+  OnMessage onMessage;
+  OnClose onClose;
+  std::string outBuf; // framed, not yet accepted by the socket
+  std::string inBuf;  // received, not yet parsed
+  std::string message; // fragments of the message being received
+  bool messageBinary = false;
+  bool flushScheduled = false;
+};
@@ -0,0 +1,177 @@
+#include "ws_tts.hpp"
+#include "log/log.hpp"
+#include <chrono>
+#include <ctime>
+#include <random>
+
+// 32 hex digits, the form Azure expects for request and connection ids
+static auto newId() -> std::string
+{
+  static std::mt19937_64 rng{std::random_device{}()};
+  static const char digits[] = "0123456789abcdef";
+  std::string ret;
+  for (auto i = 0; i < 2; ++i)
+  {
+    auto n = rng();
+    for (auto j = 0; j < 16; ++j, n >>= 4)
+      ret += digits[n & 15];
+  }
+  return ret;
+}
+
+static auto timestamp() -> std::string
+{
+  const auto now = std::chrono::system_clock::now();
+  const auto t = std::chrono::system_clock::to_time_t(now);
+  const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+  std::tm tm;
+  gmtime_r(&t, &tm);
+  char buf[32];
+  const auto sz = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+  snprintf(buf + sz, sizeof(buf) - sz, ".%03dZ", static_cast<int>(ms));
+  return buf;
+}
+
+// value of a "Name:value" line in a block of CRLF separated headers
+static auto header(std::string_view headers, std::string_view name) -> std::string_view
+{
+  for (size_t pos = 0; pos < headers.size();)
+  {
+    auto end = headers.find("\r\n", pos);
+    if (end == std::string_view::npos)
+      end = headers.size();
+    const auto line = headers.substr(pos, end - pos);
+    pos = end + 2;
+    if (line.size() <= name.size() || line.compare(0, name.size(), name) != 0 || line[name.size()] != ':')
+      continue;
+    auto value = line.substr(name.size() + 1);
+    while (!value.empty() && value.front() == ' ')
+      value.remove_prefix(1);
+    return value;
+  }
+  return {};
+}
+
+WsTts::WsTts(EventLoop &loop, std::string url) : loop(loop), url(std::move(url)), ws(loop, "ttsWs") {}
+
+auto WsTts::synthesize(const std::string &token, const std::string &ssml, OnAudio onAudio, OnDone onDone) -> void
+{
+  this->token = token;
+  this->ssml = ssml;
+  this->onAudio = std::move(onAudio);
+  this->onDone = std::move(onDone);
+  gotAudio = false;
+  retried = false;
+  const auto id = ++turn;
+  loop.after(TurnTimeout, [this, id]() {
+    if (id != turn || !busy())
+      return;
+    LOG("websocket tts turn timed out");
+    ws.close();
+    finish(0);
+  });
+  if (ws.isOpen() && connToken == token)
+  {
+    startTurn();
+    return;
+  }
+  connect();
+}
+
+auto WsTts::connect() -> void
+{
+  connToken = token;
+  ws.open(
+    url,
+    {"Authorization: Bearer " + token, "X-ConnectionId: " + newId()},
+    [this]() {
+      send("speech.config",
+           newId(),
+           "application/json",
+           R"({"context":{"system":{"name":"SpeechSDK","version":"1.0","build":"native","lang":"C++"}}})");
+      startTurn();
+    },
+    [this](bool binary, std::string_view data) { onMessage(binary, data); },
+    [this](long status) { onClose(status); });
+}
+
+auto WsTts::startTurn() -> void
+{
+  requestId = newId();
+  send("synthesis.context",
+       requestId,
+       "application/json",
+       R"({"synthesis":{"audio":{"metadataOptions":{"sentenceBoundaryEnabled":false,"wordBoundaryEnabled":false},)"
+       R"("outputFormat":"raw-24khz-16bit-mono-pcm"}}})");
+  send("ssml", requestId, "application/ssml+xml", ssml);
+}
+
+auto WsTts::send(const std::string &path,
+                 const std::string &requestId,
+                 const std::string &contentType,
+                 const std::string &body) -> void
+{
+  ws.sendText("Path: " + path + "\r\nX-RequestId: " + requestId + "\r\nX-Timestamp: " + timestamp() +
+              "\r\nContent-Type: " + contentType + "\r\n\r\n" + body);
+}
+
+auto WsTts::onMessage(bool binary, std::string_view data) -> void
+{
+  if (!busy())
+    return;
+  if (binary)
+  {
+    // 2 bytes of big endian header length, the headers, then the audio
+    if (data.size() < 2)
+      return;
+    const auto headerSz = (static_cast<unsigned char>(data[0]) << 8) | static_cast<unsigned char>(data[1]);
+    if (data.size() < 2u + headerSz)
+      return;
+    const auto headers = data.substr(2, headerSz);
+    if (header(headers, "Path") != "audio" || header(headers, "X-RequestId") != requestId)
+      return;
+    const auto audio = data.substr(2 + headerSz);
+    if (audio.empty())
+      return;
+    gotAudio = true;
+    onAudio(audio.data(), audio.size());
+    return;
+  }
+  const auto headers = data.substr(0, data.find("\r\n\r\n"));
+  if (header(headers, "Path") == "turn.end" && header(headers, "X-RequestId") == requestId)
+    finish(200);
+}
+
+auto WsTts::onClose(long status) -> void
+{
+  if (!busy())
+    return;
+  // a reused connection may have been closed by Azure while idle, which
+  // only shows once the turn is sent; one fresh connection gets a retry
+  if (status == 0 && !gotAudio && !retried)
+  {
+    LOG("websocket tts connection dropped, reconnecting");
+    retried = true;
+    connect();
+    return;
+  }
+  finish(status);
+}
+
+auto WsTts::cancel() -> void
+{
+  if (!busy())
+    return;
+  ++turn;
+  onDone = nullptr;
+  onAudio = nullptr;
+  ws.close();
+}
+
+auto WsTts::finish(long status) -> void
+{
+  auto done = std::move(onDone);
+  onDone = nullptr;
+  onAudio = nullptr;
+  done(status);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "event_loop.hpp"
+#include "ws_conn.hpp"
+#include <functional>
+#include <string>
+
+// Azure speech synthesis over one long-lived WebSocket instead of a REST
+// request per message. A turn sends the output format and the SSML under a
+// fresh request id; audio comes back in binary frames while it is being
+// synthesized and turn.end closes the turn. Azure runs one turn at a time
+// per connection, so parallel syntheses need one WsTts each.
+class WsTts
+{
+public:
+  // raw-24khz-16bit-mono-pcm bytes as they arrive
+  using OnAudio = std::function<void(const char *, size_t)>;
+  // 200 once the turn ended, the HTTP status of a refused upgrade, 0 if the
+  // connection failed, broke off or the turn timed out
+  using OnDone = std::function<void(long status)>;
+
+  static constexpr auto TurnTimeout = std::chrono::seconds{30};
+
+  WsTts(EventLoop &, std::string url);
+
+  auto busy() const -> bool { return static_cast<bool>(onDone); }
+  // reconnects first if the connection dropped or the token changed
+  auto synthesize(const std::string &token, const std::string &ssml, OnAudio, OnDone) -> void;
+  // drops the turn without calling back; the connection goes with it since
+  // Azure would keep streaming the turn's audio
+  auto cancel() -> void;
+
+private:
+  auto connect() -> void;
+  auto startTurn() -> void;
+  auto send(const std::string &path, const std::string &requestId, const std::string &contentType, const std::string &body)
+    -> void;
+  auto onMessage(bool binary, std::string_view) -> void;
+  auto onClose(long status) -> void;
+  auto finish(long status) -> void;
+
+  EventLoop &loop;
+  std::string url;
+  WsConn ws;
+  std::string connToken; // the connection was authorized with this one
+  std::string token;
+  std::string ssml;
+  std::string requestId;
+  OnAudio onAudio;
+  OnDone onDone;
+  uint64_t turn = 0;
+  bool gotAudio = false;
+  bool retried = false;
+};